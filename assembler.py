@@ -1,5 +1,8 @@
 # The assembler for my custom CPU!
 # Takes an assembly file and translates each line to machine code. Output is always program.bin, but input can be any file.
+# Alongside program.bin it writes program.lst (a listing of every emitted instruction with its source line) and program.sym (a map of every
+# label to its bank and address). The emulator loads both to show where things happened in the source when profiling, tracing or crashing.
+# The file name can be given on the command line (python3 assembler.py program.asm) or typed in when asked.
 #
 # Abstractions:
 # SOI/SOR - There is an instruction for second operands, but the assembler abstracts it.
@@ -12,21 +15,22 @@
 # To Add:
 # - .equ values
 # - Checks for overflow errors
-# - (Maybe) call/ret
 #
 # What I won't add:
 # - Variables (use P)
 
 import struct
+import sys
 
-# Set a dictionary to assign each instruction to its mnemonic. All instructions will be converted to uppercase. There are 37 unique instructions.
+# Set a dictionary to assign each instruction to its mnemonic. All instructions will be converted to uppercase. There are 51 unique instructions.
 instructions = {"NOP": 0b00000000, "SOI": 0b10000000, "SOR": 0b10000001, "BSWCHI": 0b00100110, "BSWCHR": 0b00100111, "ADDI": 0b00000010, "ADDR": 0b00000011, 
                 "SUBI": 0b00000100, "GETP": 0b00101001, "SUBR": 0b00000101, "LDI": 0b00000110, "CPY": 0b00000111, "MOVMI": 0b00001000, "MOVMR": 0b00001001, 
                 "SHL": 0b10001011, "SHR": 0b10001101, "JMPI": 0b00001010, "JMPR": 0b00001011, "JEI": 0b00001100, "JER": 0b00001101, "JNEI": 0b00001110, 
                 "JNER": 0b00001111, "CMPI": 0b00010000, "CMPR": 0b00010001, "LOADI": 0b00010010, "LOADR": 0b00010011, "STORI": 0b00010100, 
                 "STORR": 0b00010101, "PUSHI": 0b00010110,  "PUSHR": 0b00010111, "POP": 0b00011001, "INCB": 0b00011000, "DECB": 0b00011010, 
                 "INCR": 0b00011011, "DECR": 0b00011101, "ANDI": 0b00011110, "ANDR": 0b00011111, "ORI": 0b00100000, "ORR": 0b00100001, "XORI": 0b00100010, 
-                "XORR": 0b00100011, "NOT": 0b00100101}
+                "XORR": 0b00100011, "NOT": 0b00100101, "HLT": 0b00101010, "WAIT": 0b00101010, "EI": 0b00101011, "DI": 0b00101100, 
+                "IRET": 0b00101101, "TAS": 0b00110001, "CAS": 0b00110010, "CALLI": 0b00101110, "CALLR": 0b00101111, "RET": 0b00110000}
 
 # Set the register IDs (will likely be put as a decimal value in the output text file)
 registerIDs = {"A": 0x01, "B": 0x02, "C": 0x03, "D": 0x04, "BI": 0x05, "P": 0x06, "S": 0x07}
@@ -40,6 +44,12 @@ inputString = ""
 bankOffset = 0
 memoryOffset = 0
 originalChar = ""
+fileName = ""
+
+# Every instruction that ends up in program.bin, in order, as [position, bytes, inserted, line number, source]. Position is counted from the bytes
+# that were actually emitted, so it is always where the emulator will load the instruction no matter what the offset bookkeeping above says.
+listing = []
+listingPosition = 0
 
 # This function gets the locations of all the labels in the code.
 def GetLabels(lines):
@@ -51,7 +61,7 @@ def GetLabels(lines):
 
             # Remove the : from the line so that it can be jumped to in a similar way to x86 and so that the assembler won't 
             # identify it as a new label when jumping.
-            labels[line[:-1]] = [bankOffset, memoryOffset]
+            labels[line[:-1]] = [memoryOffset // 256, memoryOffset % 256]
         if ";" in line:
             # If there is a comment on the line, remove and ignore it.
             line = line.split(";")[0].strip()
@@ -66,7 +76,11 @@ def GetLabels(lines):
             else:
                 # If there are more than two operands, return an error.
                 print("Error: too many operands on line: " + currentLine + ". Cannot assemble.")
-                exit()
+                exit(1)
+            for token in line.split(',')[1:]:
+                # Label operands get an extra SOI with the label's bank, so count it too. Otherwise labels after it are off when jumping forward.
+                if "_" in token:
+                    memoryOffset += 2
     memoryOffset = 0
 
 # This function assembles the given opcode and operand and turns them into binary code
@@ -105,10 +119,11 @@ def AssembleInstruction(instruction, operand):
                 print("Label error: There is no label by the name: " + str(operand) + ". Cannot assemble.")
                 print("Error is on line: " + str(currentLine))
                 print("Did you mistype it?")
-                exit()
+                exit(1)
         elif ((operand[0] == "'" and operand[-1] == "'") or (operand[0] == '''"''' and operand[-1] == '''"''')) and len(operand) < 4:
             # If there is a character as the operand, turn it into its integer ASCII value and pass it as an integer value. Only supports lowercase.
             # Only supports one character. If you try more, it will result in an error.
+            memoryOffset += 2
             operand = ord(operand[1].lower())
             return struct.pack('BB', instructions[instruction], operand)
 
@@ -134,20 +149,24 @@ def AssembleInstruction(instruction, operand):
         else:
             # If the operand is not valid, stop assembly and inform the user.
             print("Error. Invalid operand on line: " + str(currentLine) + ". Cannot assemble.")
-            exit()
+            exit(1)
     elif instruction != "":
         # If the instruction is invalid, stop assembly and inform the user. Whitespace is ignored.
         print("ERROR: Unknown instruction on line: " + str(currentLine) + ". Cannot assemble.")
         print("Maybe you missed a typo?")
-        exit()
+        exit(1)
 
 # This function takes an instruction and separates it into its opcode and operand
 def ParseInstruction(line):
     global memoryOffset
     global bankOffset
     global currentLine
+    global listingPosition
     currentLine += 1
 
+    # Keep the line as it was written for the listing
+    source = line.strip()
+
     # Is there a comment on the line?
     if ';' in line:
         # If so, remove it.
@@ -160,7 +179,7 @@ def ParseInstruction(line):
 
         # Remove the : from the line so that it can be jumped to in a similar way to x86 and so that the assembler won't 
         # identify it as a new label when jumping.
-        labels[line[:-1]] = [bankOffset, memoryOffset]
+        labels[line[:-1]] = [bankOffset + memoryOffset // 256, memoryOffset % 256]
     elif line:
         # If the line is not a label or a comment and it exists, process it
         operand = 0                         # Default operand value is 0 because all instructions are 16 bits wide, even with no operands.
@@ -178,6 +197,9 @@ def ParseInstruction(line):
         if len(tokens) > 1:
             operand = tokens[1].strip()
 
+        # Remember where this line's code starts so it can be put in the listing
+        first = len(assembledCode)
+
         # Abstract away SOI/SOR
         if len(tokens) > 2 and len(tokens) < 4:
             # If there are two operands and the second one is an immediate value, add the second operand instruction before the original instruction
@@ -193,8 +215,35 @@ def ParseInstruction(line):
         # Assemble the code and add it to the array of assembled code
         assembledCode.append(AssembleInstruction(opcode, operand))
 
-# Get the name of the asm source file
-fileName = input("Enter the name of your asm file: ")
+        # Everything this line produced except the last instruction is a SOI/SOR that the assembler put in for you
+        emitted = [item for item in assembledCode[first:] if item is not None]
+        for i in range(len(emitted)):
+            listing.append([listingPosition, emitted[i], i < len(emitted) - 1, currentLine, source])
+            listingPosition += len(emitted[i])
+
+# This function writes the listing. Each line is bank:address, the two bytes, + if the assembler inserted the instruction (. if you wrote it),
+# then file:line and the source line. All numbers except the bytes are decimal like everywhere else in the assembler.
+def WriteListing(name):
+    with open(name, 'w') as listingFile:
+        listingFile.write("; Listing of " + fileName + "\n")
+        listingFile.write("; bank:address  bytes  inserted  file:line  source\n")
+        for position, code, inserted, lineNumber, source in listing:
+            listingFile.write("%03d:%03d  %02x %02x  %s  %s:%d  %s\n" % (position // 256, position % 256, code[0], code[1],
+                                                                       "+" if inserted else ".", fileName, lineNumber, source))
+
+# This function writes the symbol map. Each line is a label followed by its bank and address in decimal.
+def WriteSymbols(name):
+    with open(name, 'w') as symbolFile:
+        symbolFile.write("; Symbols from " + fileName + "\n")
+        symbolFile.write("; label bank address\n")
+        for label in labels:
+            symbolFile.write("%s %d %d\n" % (label, labels[label][0], labels[label][1]))
+
+# Get the name of the asm source file, either from the command line or by asking for it
+if len(sys.argv) > 1:
+    fileName = sys.argv[1]
+else:
+    fileName = input("Enter the name of your asm file: ")
 
 # Open the asm source file
 with open(fileName, 'r') as AssemblyFile:
@@ -227,5 +276,9 @@ print(str(memoryOffset) + " bytes assembled.")
 with open('program.bin', 'wb') as binary_file:
     binary_file.write(b''.join(assembledCode))
 
+# Write the listing and symbol map next to it so the emulator can tell you where you are in the source
+WriteListing('program.lst')
+WriteSymbols('program.sym')
+
 
 # This grew very fast. The first functional version had ~40 lines of code.
@@ -0,0 +1,88 @@
+# A client for the emulator's server mode. Start the server with "./emulator --serve", then use this to run programs on it.
+#
+# Usage:
+# python3 client.py run [program.bin] [instruction limit] [key presses]
+#     Key presses are a list like "1000:d,5000:q", which presses D after 1000 instructions and Q after 5000.
+# python3 client.py stats
+#
+# The socket is /tmp/emulator.sock unless the EMULATOR_SOCKET environment variable says otherwise.
+
+import os
+import socket
+import struct
+import sys
+
+# These have to match the structs in the server region of emulator.c
+REQUEST_RUN = 1
+REQUEST_STATS = 2
+requestFormat = "=IIIIQ"
+runResponseFormat = "=QQQQI12BII"
+statsResponseFormat = "=QQQQQQQQII"
+results = ["finished", "instruction limit reached", "halted with nothing to wake it", "bad request"]
+
+# Open a connection to the server and send it a request
+def SendRequest(request):
+    connection = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    connection.connect(os.environ.get("EMULATOR_SOCKET", "/tmp/emulator.sock"))
+    connection.sendall(request)
+    return connection
+
+# Read exactly length bytes from the server
+def Receive(connection, length):
+    data = b""
+    while len(data) < length:
+        chunk = connection.recv(length - len(data))
+        if not chunk:
+            print("Error: the server closed the connection.")
+            exit()
+        data += chunk
+    return data
+
+def Run(fileName, limit, keys):
+    with open(fileName, "rb") as binaryFile:
+        image = binaryFile.read()
+
+    script = b""
+    for keyPress in keys:
+        at, key = keyPress.split(":")
+        script += struct.pack("=II", int(at), ord(key))
+
+    request = struct.pack(requestFormat, REQUEST_RUN, len(image), len(script) // 8, 0, limit) + image + script
+    connection = SendRequest(request)
+    response = struct.unpack(runResponseFormat, Receive(connection, struct.calcsize(runResponseFormat)))
+    connection.close()
+
+    instructions, nanoseconds, ramDigest, vramDigest, result = response[:5]
+    registers = response[5:17]
+    privateBanks, sharedBanks = response[17:]
+    print("Result: " + results[result])
+    print("Instructions: " + str(instructions))
+    print("Time: " + str(nanoseconds // 1000) + " microseconds")
+    for name, value in zip(["A", "B", "C", "D", "P", "BI", "S", "PCH", "PCL", "F"], registers):
+        print("%s: 0x%02x" % (name, value))
+    print("RAM digest: %016x" % ramDigest)
+    print("VRAM digest: %016x" % vramDigest)
+    print("Memory: %i private banks (%i bytes), %i shared with the program image" % (privateBanks, privateBanks * 256, sharedBanks))
+
+def Stats():
+    connection = SendRequest(struct.pack(requestFormat, REQUEST_STATS, 0, 0, 0, 0))
+    response = struct.unpack(statsResponseFormat, Receive(connection, struct.calcsize(statsResponseFormat)))
+    connection.close()
+
+    uptime, runs, errors, timeouts, instructions, busyTime, p50, p99, workers, queueDepth = response
+    seconds = uptime / 1e9
+    print("Workers: %i, queue depth: %i" % (workers, queueDepth))
+    print("Runs: %i in %.1f seconds (%.1f runs per second)" % (runs, seconds, runs / seconds))
+    print("Bad requests: %i, runs stopped by the instruction limit: %i" % (errors, timeouts))
+    print("Instructions: %i (%.2f million per second of worker time)" % (instructions, instructions / max(busyTime / 1e3, 1)))
+    print("Latency: p50 under %i microseconds, p99 under %i microseconds" % (p50, p99))
+
+if len(sys.argv) > 1 and sys.argv[1] == "stats":
+    Stats()
+elif len(sys.argv) > 1 and sys.argv[1] == "run":
+    fileName = sys.argv[2] if len(sys.argv) > 2 else "program.bin"
+    limit = int(sys.argv[3]) if len(sys.argv) > 3 else 0
+    keys = sys.argv[4].split(",") if len(sys.argv) > 4 and sys.argv[4] else []
+    Run(fileName, limit, keys)
+else:
+    print("Usage: python3 client.py run [program.bin] [instruction limit] [key presses], or python3 client.py stats")
@@ -0,0 +1,43 @@
+; Two cores each add 100 to the same counter, using TAS as a lock so that no additions get lost. Run it with "./emulator --cores 2".
+; Core 1 starts at _WORKER (labels used as a second operand have to be uppercase). When core 0 is done it waits for core 1, then D holds the
+; counter, which should be 200 (0xc8).
+_start:
+BSWCHI, 250             ; Go to the I/O bank
+LDI, A, _WORKER         ; Core 1 starts at the worker code too
+STORI, A, 210           ; Core 1's entry address
+LDI, A, 0
+STORI, A, 211           ; Core 1's entry bank
+LDI, A, 2
+STORI, A, 235           ; Start core 1 (bit 1 of CORE_START)
+
+_WORKER:
+BSWCHI, 1               ; The counter is at bank 1 address 0, the lock at address 1, and the done flag at address 2
+LDI, C, 0               ; How many times this core has added to the counter
+_lock:
+TAS, A, 1               ; Try to take the lock
+JNEI, _lock             ; Equal is only set if the lock was free
+LOADI, B, 0             ; Add one to the counter while holding the lock
+INCR, B
+STORI, B, 0
+LDI, A, 0
+STORI, A, 1             ; Let go of the lock
+INCR, C
+CMPI, C, 100
+JNEI, _lock
+
+BSWCHI, 250
+LOADI, A, 230           ; Which core is this?
+CMPI, A, 0
+JEI, _main
+BSWCHI, 1
+LDI, A, 1
+STORI, A, 2             ; Core 1 sets the done flag and stops
+HLT
+
+_main:
+BSWCHI, 1
+_wait:
+LOADI, A, 2             ; Wait for core 1 to finish
+CMPI, A, 1
+JNEI, _wait
+LOADI, D, 0             ; D = the counter
@@ -0,0 +1,20 @@
+; Example program: Use the performance counters to time a loop. At the end, A has the number of cycles the loop took (low byte only), and the
+; top left of the screen shows it as a color.
+_start:
+    BSWCHI, 250             ; The counters are in the I/O bank
+    STORI, A, 236           ; Latch the counters. Any value can be written.
+    LOADI, C, 237           ; Get the low byte of the cycle counter
+
+    LDI, B, 20
+_loop:
+    DECR, B                 ; Do some work
+    CMPI, B, 0
+    JNEI, _loop
+
+    STORI, A, 236           ; Latch the counters again
+    LOADI, A, 237           ; Get the low byte of the cycle counter
+    SUBR, C                 ; A = end - start
+
+    BSWCHI, 251             ; Show the result on the screen
+    LDI, P, 0
+    MOVMR, A
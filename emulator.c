@@ -29,6 +29,34 @@
  * 
  * 01/06/23   AND    Added the ability to scan for keyboard input and memory mapped the keyboard to a byte in RAM. With this, the emulator is essentially
  *                   complete.
+ * 
+ * 10/19/26   AND    Added an interrupt controller with keyboard, timer, and vblank sources and the HLT, EI, DI, and IRET instructions. The screen and
+ *                   SDL events are now serviced about 60 times per second instead of after every instruction, and a halted CPU sleeps.
+ * 
+ * 10/19/26   AND    Banks are really 256 bytes now, programs longer than one bank load into the following banks, and PC carries into the next
+ *                   bank. The run loop is split up so that recompiler.py can use emulator.c as the runtime for compiled programs.
+ * 
+ * 10/19/26   AND    Added server mode. Programs can be sent over a Unix socket and run without a window by a pool of worker processes.
+ * 
+ * 10/19/26   AND    Added a memory bus. Every bank has a descriptor that is either plain RAM or a device, and the I/O bank has a table of device
+ *                   registers. The keyboard, interrupt controller, and VRAM are devices on the bus now.
+ * 
+ * 10/19/26   AND    Added performance counters for cycles, instructions, bank switches, and frames, memory mapped with a latch register.
+ * 
+ * 10/19/26   AND    The emulator reads the listing and symbol map from the assembler. Added --trace and --profile, and the register dump and crashes
+ *                   show the source line and label PC is at.
+ * 
+ * 10/19/26   AND    Added hot reload. With --watch or --watch-asm the emulator loads each new version of the program in the same window.
+ * 
+ * 10/19/26   AND    RAM is a table of reference counted banks now. Banks are shared until they are written, so resetting or copying a machine only
+ *                   touches the bank table.
+ * 
+ * 10/19/26   AND    Added up to 8 cores, each on its own thread, with core start registers and the TAS and CAS instructions. --deterministic runs
+ *                   them one at a time in a fixed order for tests.
+ * 
+ * 10/19/26   AND    The emulator keeps live stats in shared memory (speed, idle time, frame and event times, PC) for stats.py to show.
+ * 
+ * 10/19/26   AND    Added the CALLI, CALLR, and RET instructions. Fixed JMPR writing the bank past the end of PC.
  */
 
 /* 
@@ -38,8 +66,22 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include <SDL2/SDL.h>       // I believe SDL has a keyboard module I can use. Will be helpful.
-#include <time.h>           // Not implemented yet. Will be the PIT, speed will eventually be set.
+#include <time.h>           // Used to time the programs that the server runs
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/inotify.h>
+#include <pthread.h>
 
 // Reminder: stdbool boolean values are 1 and 0, very helpful in this context.
 
@@ -58,25 +100,250 @@
 
 #pragma region Variables
 // Get the total size of the Computer's RAM. This equates to ~65.5kb.
-#define BANK_SIZE 0xFF              // 256 (0xFF) banks
-#define NUM_BANKS 0xFF              // 256 (0xFF) bytes per bank
+#define BANK_SIZE 0x100             // 256 (0x100) bytes per bank
+#define NUM_BANKS 0x100             // 256 (0x100) banks
+
+// Everything that belongs to a single core of the CPU is CORE_LOCAL. Each core runs on its own host thread (see Cores), so each gets its own copy.
+#define CORE_LOCAL _Thread_local
 
 // For easier understanding, define byte and word instead of using their C identifiers.
 typedef unsigned char byte;
 typedef unsigned short word;
 
-// Memory bank variable, which holds an array of 256 bytes called address.
+// Memory bank variable, which holds an array of 256 bytes called address. Banks can be shared by more than one bank table (see Banks below).
 typedef struct {
     byte address[BANK_SIZE];
+    int references;                 // How many bank tables and caches point to this bank
 } MemoryBank;
 
-MemoryBank RAM[NUM_BANKS];          // An array of 256 memory bank variables
+// Every bank starts out as the shared bank of zeros, so an empty machine doesn't take up any memory for its RAM
+MemoryBank zeroBank;
+MemoryBank* RAM[NUM_BANKS] = { [0 ... NUM_BANKS - 1] = &zeroBank };     // The machine's bank table. Each entry points to the memory of that bank.
 
-bool JMPFunction = false;           // This flag is activated when a JMP instruction is called. This allows the program to jump to and read from the correct
-                                    // spot.
+CORE_LOCAL bool JMPFunction = false;    // This flag is activated when a JMP instruction is called. This allows the program to jump to and read
+                                        // from the correct spot.
 
 #pragma endregion Variables
 
+#pragma region Memory Bus
+// Every memory access from the CPU goes through the bus, which has a descriptor for each bank. A plain RAM bank has pointers straight to its
+// memory, so reading or writing it is still a single indexed load or store. A device gets a bank by setting a NULL pointer and a handler, which
+// is only called for that bank. Devices that only need to know when a bank changes, like VRAM, keep the fast read pointer and only handle writes.
+typedef byte (*ReadHandler)(byte bank, byte address);
+typedef void (*WriteHandler)(byte bank, byte address, byte value);
+
+typedef struct {
+    byte* read;                     // Memory to read from directly. NULL means readHandler is used.
+    byte* write;                    // Memory to write to directly. NULL means writeHandler is used.
+    ReadHandler readHandler;
+    WriteHandler writeHandler;
+} BankDescriptor;
+
+BankDescriptor bus[NUM_BANKS];
+
+#pragma region Banks
+// RAM is copy-on-write one bank at a time. A bank that more than one bank table (or the image cache) points to is shared and read-only, so the bus
+// has no write pointer for it. The first write to it goes to WriteShared, which gives this machine its own copy of the bank and points the bus at
+// that. This makes a copy of a whole machine's memory cost one copy of the bank table, and banks that are never written, like the program's
+// code or empty RAM, are only in memory once.
+unsigned long long bankCopies = 0;      // Copies made because a shared bank was written
+
+void WriteShared(byte bank, byte address, byte value);
+
+MemoryBank* NewBank(){
+    MemoryBank* memory = malloc(sizeof(MemoryBank));
+    if(memory == NULL){
+        fprintf(stderr, "Error allocating memory for a RAM bank.\n");
+        exit(1);
+    }
+    memory->references = 0;
+    return memory;
+}
+
+// The zero bank is never counted or freed
+void AcquireBank(MemoryBank* memory){
+    if(memory != &zeroBank){
+        memory->references++;
+    }
+}
+void ReleaseBank(MemoryBank* memory){
+    if(memory != &zeroBank && --memory->references == 0){
+        free(memory);
+    }
+}
+
+bool IsShared(int bank){
+    return RAM[bank] == &zeroBank || RAM[bank]->references > 1;
+}
+
+// Plain RAM banks write straight to memory only if this machine is the only one using the bank. The descriptor is only written when it changes,
+// since other cores read it all the time.
+void RefreshBus(int bank){
+    byte* memory = IsShared(bank) ? NULL : RAM[bank]->address;
+    if(bus[bank].writeHandler == WriteShared && bus[bank].write != memory){
+        bus[bank].write = memory;
+    }
+}
+
+// Put different memory in a bank
+void SetBank(int bank, MemoryBank* memory){
+    MemoryBank* old = RAM[bank];
+    AcquireBank(memory);
+    RAM[bank] = memory;
+    if(bus[bank].read == old->address){
+        bus[bank].read = memory->address;
+    }
+    RefreshBus(bank);
+    ReleaseBank(old);
+}
+
+// Get a bank that can be written to, copying it first if it is shared
+MemoryBank* WritableBank(int bank){
+    if(IsShared(bank)){
+        MemoryBank* copy = NewBank();
+        memcpy(copy->address, RAM[bank]->address, BANK_SIZE);
+        SetBank(bank, copy);
+        bankCopies++;
+    }
+    return RAM[bank];
+}
+
+void WriteShared(byte bank, byte address, byte value){
+    __atomic_store_n(&WritableBank(bank)->address[address], value, __ATOMIC_RELEASE);
+    // The bank might have stopped being shared without being copied, so let the next write take the fast path either way
+    RefreshBus(bank);
+}
+
+// A copy of a machine's memory. Taking one only copies the bank table, since every bank becomes shared until one side writes to it.
+typedef struct {
+    MemoryBank* banks[NUM_BANKS];
+} RAMSnapshot;
+
+void SaveRAM(RAMSnapshot* snapshot){
+    memcpy(snapshot->banks, RAM, sizeof(snapshot->banks));
+    for(int bank = 0; bank < NUM_BANKS; bank++){
+        MemoryBank* memory = RAM[bank];
+        if(memory == &zeroBank){
+            // Already shared and never counted, so there is nothing to do
+            continue;
+        }
+        memory->references++;
+        // The bank is shared now, so writes have to go through WriteShared. Nothing else about the bus changes.
+        if(bus[bank].write != NULL && bus[bank].writeHandler == WriteShared){
+            bus[bank].write = NULL;
+        }
+    }
+}
+void RestoreRAM(RAMSnapshot* snapshot, int first, int last){
+    for(int bank = first; bank <= last; bank++){
+        SetBank(bank, snapshot->banks[bank]);
+    }
+}
+// The machine's banks stop being shared here, but the bus isn't changed. The first write to each one finds out in WriteShared and turns the
+// fast path back on.
+void FreeSnapshot(RAMSnapshot* snapshot){
+    for(int bank = 0; bank < NUM_BANKS; bank++){
+        ReleaseBank(snapshot->banks[bank]);
+    }
+}
+
+// Count the banks this machine has to itself and the ones it shares with the image cache or another copy of the machine. The zero bank isn't
+// counted since it is always there.
+void CountBanks(int* privateBanks, int* sharedBanks){
+    *privateBanks = 0;
+    *sharedBanks = 0;
+    for(int bank = 0; bank < NUM_BANKS; bank++){
+        if(RAM[bank] == &zeroBank){
+            continue;
+        }
+        if(RAM[bank]->references > 1){
+            (*sharedBanks)++;
+        }else{
+            (*privateBanks)++;
+        }
+    }
+}
+#pragma endregion Banks
+
+// The I/O bank is shared by several devices, so it has another table with a read and a write handler for each address. An address without
+// handlers is plain RAM.
+#define IO_BANK 250
+
+typedef struct {
+    ReadHandler read;
+    WriteHandler write;
+} IORegister;
+
+IORegister ioRegisters[BANK_SIZE];
+
+// Every core can see memory that another one writes, so plain RAM is read with acquire and written with release ordering. On x86 those are
+// ordinary loads and stores, so the single-core emulator doesn't pay anything for it.
+static inline byte ReadMemory(byte bank, byte address){
+    byte* memory = bus[bank].read;
+    if(memory != NULL){
+        return __atomic_load_n(&memory[address], __ATOMIC_ACQUIRE);
+    }
+    return bus[bank].readHandler(bank, address);
+}
+
+static inline void WriteMemory(byte bank, byte address, byte value){
+    byte* memory = bus[bank].write;
+    if(memory != NULL){
+        __atomic_store_n(&memory[address], value, __ATOMIC_RELEASE);
+        return;
+    }
+    bus[bank].writeHandler(bank, address, value);
+}
+
+byte ReadIO(byte bank, byte address){
+    if(ioRegisters[address].read != NULL){
+        return ioRegisters[address].read(bank, address);
+    }
+    // Plain RAM in the I/O bank has the same ordering as everywhere else, since cores use it to talk to each other too
+    return __atomic_load_n(&RAM[bank]->address[address], __ATOMIC_ACQUIRE);
+}
+
+void WriteIO(byte bank, byte address, byte value){
+    if(ioRegisters[address].write != NULL){
+        ioRegisters[address].write(bank, address, value);
+        return;
+    }
+    __atomic_store_n(&WritableBank(bank)->address[address], value, __ATOMIC_RELEASE);
+}
+
+// Handlers that don't do anything. Used for read-only registers, and by the benchmark for fake devices.
+byte ReadNothing(byte bank, byte address){
+    return 0;
+}
+void WriteNothing(byte bank, byte address, byte value){
+}
+
+// Give a range of banks to a device. A NULL handler leaves that kind of access as plain RAM.
+void MapDevice(int first, int last, ReadHandler read, WriteHandler write){
+    for(int bank = first; bank <= last; bank++){
+        bus[bank].read = read == NULL ? RAM[bank]->address : NULL;
+        bus[bank].write = NULL;
+        bus[bank].readHandler = read;
+        bus[bank].writeHandler = write == NULL ? WriteShared : write;
+        RefreshBus(bank);
+    }
+}
+
+// Give a range of addresses in the I/O bank to a device. A NULL handler leaves that kind of access as plain RAM.
+void MapRegisters(int first, int last, ReadHandler read, WriteHandler write){
+    for(int address = first; address <= last; address++){
+        ioRegisters[address].read = read;
+        ioRegisters[address].write = write;
+    }
+}
+// Make every bank plain RAM again
+void ResetBus(){
+    MapDevice(0, NUM_BANKS - 1, NULL, NULL);
+    memset(ioRegisters, 0, sizeof(ioRegisters));
+    MapDevice(IO_BANK, IO_BANK, ReadIO, WriteIO);
+}
+#pragma endregion Memory Bus
+
 #pragma region Graphics
 // Define the screen parameters
 #define SCREEN_WIDTH 512
@@ -86,6 +353,17 @@ bool JMPFunction = false;           // This flag is activated when a JMP instruc
 SDL_Window* window = NULL;
 SDL_Renderer* renderer = NULL;
 
+// VRAM is the banks from 251 to 255. Reads are plain RAM, but writes go through the bus so that the screen is only redrawn when it has changed.
+#define VRAM_FIRST_BANK 251
+#define VRAM_LAST_BANK 255
+bool vramDirty = true;              // Set with a release store after the VRAM write, and taken with an exchange before the screen is read
+unsigned long long framesPresented = 0;     // Frames where VRAM had changed, for the performance counters
+
+void WriteVRAM(byte bank, byte address, byte value){
+    __atomic_store_n(&WritableBank(bank)->address[address], value, __ATOMIC_RELEASE);
+    __atomic_store_n(&vramDirty, true, __ATOMIC_RELEASE);
+}
+
 // Initialize SDL and create window and renderer
 int initSDL() {
     window = SDL_CreateWindow("8-bit CPU Emulator", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN);
@@ -136,6 +414,16 @@ void UpdateTexture(int x, int y, byte color) {
 
 // Draw something to the screen based on the value in the computer's RAM
 void DrawToScreen(){
+    if(__atomic_exchange_n(&vramDirty, false, __ATOMIC_ACQ_REL) == false){
+        // There is nothing new to draw if VRAM hasn't changed
+        return;
+    }
+    framesPresented++;
+    if(renderer == NULL){
+        // There is no window in server mode
+        return;
+    }
+
     // Set the X and Y values to draw to
     int x = 0;
     int y = 0;
@@ -146,7 +434,8 @@ void DrawToScreen(){
             // Iterate 256 times. That makes 4 whole banks of memory to be written to the screen.
 
             // Write to the screen starting from bank 251 address 0
-            UpdateTexture(x, y, RAM[251+i].address[j]);
+            // Other cores can be writing VRAM while this reads it, so go through the bus like they do
+            UpdateTexture(x, y, ReadMemory(VRAM_FIRST_BANK + i, j));
             if(x > 512 - 16){
                 // If the X value has reached the right side of the screen, increment y by 16 and reset X to 0
                 x = 0;
@@ -202,6 +491,9 @@ byte JEI = 0b00001100;          // Jump if equal to an immediate address
 byte JER = 0b00001101;          // Jump if equal to the address in two registers
 byte JNEI = 0b00001110;         // Jump if not equal to an immediate address
 byte JNER = 0b00001111;         // Jump if not equal to an address in two registers
+byte CALLI = 0b00101110;        // Call - push the return address and jump to an immediate address
+byte CALLR = 0b00101111;        // Call the address in two registers
+byte RET = 0b00110000;          // Return - pop the return address that a call pushed and jump to it
 byte CMPI = 0b00010000;         // Compare a register with an immediate value
 byte CMPR = 0b00010001;         // Compare a register with another register
 
@@ -228,29 +520,44 @@ byte ORR = 0b00100001;          // OR register - perform an OR instruction with
 byte XORI = 0b00100010;         // XOR immediate - perform an XOR instruction with a register and a given immediate value
 byte XORR = 0b00100011;         // XOR register - perform an XOR instruction with the values of two registers
 byte NOT = 0b00100101;          // NOT - perform a bitwise NOT operation on the value in a register
+
+// Interrupt Instructions
+byte HLT = 0b00101010;          // Halt - stop executing until an unmasked interrupt arrives. WAIT in the assembler is the same instruction.
+byte EI = 0b00101011;           // Enable interrupts
+byte DI = 0b00101100;           // Disable interrupts
+byte IRET = 0b00101101;         // Return from an interrupt handler
+
+// Multi-core Instructions
+byte TAS = 0b00110001;          // Test and set - atomically get a byte into a register and set the byte to 1
+byte CAS = 0b00110010;          // Compare and swap - atomically replace the byte P points to if it holds the value of a register
 #pragma endregion instructions
 
 #pragma region registers/memory
-byte A = 0x00;                  // Accumulator register
-byte B = 0x00;                  // General-purpose register
-byte C = 0x00;                  // General-purpose register
-byte D = 0x00;                  // General-purpose register
+CORE_LOCAL byte A = 0x00;       // Accumulator register
+CORE_LOCAL byte B = 0x00;       // General-purpose register
+CORE_LOCAL byte C = 0x00;       // General-purpose register
+CORE_LOCAL byte D = 0x00;       // General-purpose register
 
-byte P = 0x00;                  // Pointer register
+CORE_LOCAL byte P = 0x00;       // Pointer register
 
-byte PC[] = {0x00, 0x00};       // Program counter. Upper 8 bits are the memory bank, lower 8 bits are the address.
+CORE_LOCAL byte PC[] = {0x00, 0x00}; // Program counter. Upper 8 bits are the memory bank, lower 8 bits are the address.
 
-byte ROP = 0x00;                // Opcode register. Holds the 7-bit opcodes.
-byte DR1 = 0x00;                // Value register 1. Holds the first operand or the only operand, depending on the instruction
-byte DR2 = 0x00;                // Value register 2. If there are two operands, this register will hold the second one.
+CORE_LOCAL byte ROP = 0x00;     // Opcode register. Holds the 7-bit opcodes.
+CORE_LOCAL byte DR1 = 0x00;     // Value register 1. Holds the first operand or the only operand, depending on the instruction
+CORE_LOCAL byte DR2 = 0x00;     // Value register 2. If there are two operands, this register will hold the second one.
 
 // Flags register. Flags in order are negative, carry, equal, and overflow.
-bool F[] = {0, 0, 0, 0};
+CORE_LOCAL bool F[] = {0, 0, 0, 0};
 
-byte BI = 0x00;                 // Bank register
-byte S = 0x00;                  // Stack pointer
+CORE_LOCAL byte BI = 0x00;      // Bank register
+CORE_LOCAL byte S = 0x00;       // Stack pointer
 
-byte stack[0xFF];               // Stack memory bank
+CORE_LOCAL byte stack[0x100];   // Stack memory bank. S is a byte, so every value it can have is a valid index.
+
+CORE_LOCAL unsigned long long bankSwitches = 0; // Number of BSWCHI/BSWCHR instructions executed, for the performance counters
+
+CORE_LOCAL bool IME = false;    // Interrupt master enable. Set by EI, cleared by DI and when an interrupt is taken.
+CORE_LOCAL bool halted = false; // Set by HLT. The CPU does nothing until an interrupt wakes it up.
 #pragma endregion registers/memory
 
 #pragma region pointers
@@ -265,16 +572,449 @@ byte BNK = 0x05;// Bank Register
 byte PTR = 0x06;// Pointer Register
 byte SP = 0x07; // Stack Pointer
 
-// Register Pointers
-byte* A_ptr = &A;
-byte* B_ptr = &B;
-byte* C_ptr = &C;
-byte* D_ptr = &D;
-byte* BI_ptr = &BI;
-byte* P_ptr = &P;
-byte* S_ptr = &S;
+// Register Pointers. These are macros since every core has its own registers, so where they are depends on which core's thread asks.
+#define A_ptr (&A)
+#define B_ptr (&B)
+#define C_ptr (&C)
+#define D_ptr (&D)
+#define BI_ptr (&BI)
+#define P_ptr (&P)
+#define S_ptr (&S)
 #pragma endregion pointers
 
+#pragma region Interrupts
+// The interrupt controller is memory mapped into the same bank as the keyboard. The vector table holds an address and a bank for every source,
+// and the enable and pending registers have one bit per source.
+#define INT_VECTOR_TABLE 224        // Addresses 224-229. Address/bank pairs for the keyboard, timer, and vblank handlers, in that order.
+#define INT_ENABLE 232              // Set a bit to unmask its source
+#define INT_PENDING 233             // A bit is set when its source has fired. It is cleared when the handler is entered.
+#define TIMER_PERIOD 234            // Timer interval in milliseconds. 0 stops the timer.
+#define KEYBOARD_ADDRESS 254        // Last key that was pressed
+
+enum InterruptSources { IRQ_KEYBOARD, IRQ_TIMER, IRQ_VBLANK };
+
+// Any core can use these registers while core 0 raises and takes interrupts, so they are only used with atomic operations
+byte interruptEnable = 0x00;        // INT_ENABLE register
+byte interruptPending = 0x00;       // INT_PENDING register
+byte timerPeriod = 0x00;            // TIMER_PERIOD register
+byte keyboard = 0x00;               // Last key that was pressed
+
+// The interrupt controller registers in the I/O bank
+byte ReadInterruptRegister(byte bank, byte address){
+    if(address == INT_ENABLE){
+        return __atomic_load_n(&interruptEnable, __ATOMIC_ACQUIRE);
+    }else if(address == INT_PENDING){
+        return __atomic_load_n(&interruptPending, __ATOMIC_ACQUIRE);
+    }
+    return __atomic_load_n(&timerPeriod, __ATOMIC_ACQUIRE);
+}
+void WriteInterruptRegister(byte bank, byte address, byte value){
+    if(address == INT_ENABLE){
+        __atomic_store_n(&interruptEnable, value, __ATOMIC_RELEASE);
+    }else if(address == INT_PENDING){
+        __atomic_store_n(&interruptPending, value, __ATOMIC_RELEASE);
+    }else{
+        __atomic_store_n(&timerPeriod, value, __ATOMIC_RELEASE);
+    }
+}
+
+// The keyboard register. Programs can write to it too, usually to clear it after reading a key.
+byte ReadKeyboard(byte bank, byte address){
+    return __atomic_load_n(&keyboard, __ATOMIC_ACQUIRE);
+}
+void WriteKeyboard(byte bank, byte address, byte value){
+    __atomic_store_n(&keyboard, value, __ATOMIC_RELEASE);
+}
+
+// Mark an interrupt source as pending. It will be taken at the next instruction boundary if it is unmasked and interrupts are enabled.
+void RaiseInterrupt(int source){
+    __atomic_fetch_or(&interruptPending, 1 << source, __ATOMIC_ACQ_REL);
+}
+
+// Returns true if an unmasked interrupt is pending. This is what wakes a halted CPU, even if interrupts are disabled.
+bool InterruptWaiting(){
+    return (__atomic_load_n(&interruptPending, __ATOMIC_ACQUIRE) & __atomic_load_n(&interruptEnable, __ATOMIC_ACQUIRE)) != 0;
+}
+
+// Put the flags into one byte, one bit per flag
+byte PackFlags(){
+    return (F[NEGATIVE] << NEGATIVE) | (F[CARRY] << CARRY) | (F[EQUAL] << EQUAL) | (F[OVERFLOW] << OVERFLOW);
+}
+
+// Take the highest priority pending interrupt. The keyboard has the highest priority, then the timer, then vblank.
+void DispatchInterrupt(){
+    byte waiting = __atomic_load_n(&interruptPending, __ATOMIC_ACQUIRE) & __atomic_load_n(&interruptEnable, __ATOMIC_ACQUIRE);
+    int source = 0;
+    while((waiting & (1 << source)) == 0){
+        source++;
+    }
+    __atomic_fetch_and(&interruptPending, ~(1 << source), __ATOMIC_ACQ_REL);
+
+    // Save the return address and the flags so that IRET can put everything back the way it was
+    stack[S] = PC[0];
+    S++;
+    stack[S] = PC[1];
+    S++;
+    stack[S] = PackFlags();
+    S++;
+
+    // Jump to the handler. Interrupts stay disabled until the handler returns or uses EI.
+    PC[1] = ReadMemory(IO_BANK, INT_VECTOR_TABLE + (source * 2));
+    PC[0] = ReadMemory(IO_BANK, INT_VECTOR_TABLE + (source * 2) + 1);
+    IME = false;
+    halted = false;
+}
+#pragma endregion Interrupts
+
+#pragma region Cores
+// The CPU can have more than one core (emulator --cores N). Each core has its own registers, flags, stack, and PC, and runs on its own host
+// thread, but they all share RAM and the devices. Core 0 starts at bank 0 address 0 like always, and it is the only core that takes interrupts and
+// services the devices. The other cores wait until a program starts them by writing to CORE_START, and then start at their entry in the core
+// entry table. Any other core stops when it runs HLT (there are no interrupts to wake it up) or runs off the end of the program, and all of them
+// stop when core 0 does.
+//
+// With --deterministic, only one core runs at a time. They take turns in order of their IDs, one device slice each, so every run of a program
+// interleaves the cores the same way. That is for tests. Without it the cores run as fast as the host lets them.
+#define MAX_CORES 8
+#define CORE_ENTRY_TABLE 208        // Addresses 208-223. Address/bank pairs with the entry point of each core, in order of ID.
+#define CORE_ID 230                 // Read-only. The ID of the core that reads it.
+#define CORE_COUNT 231              // Read-only. How many cores there are.
+#define CORE_START 235              // Writing a 1 bit starts that core. Reading gives a bit for every core that has been started.
+
+enum CoreStates { CORE_WAITING, CORE_RUNNING, CORE_FINISHED };
+
+CORE_LOCAL int coreID = 0;          // The core this thread is
+int coreCount = 1;
+bool roundRobin = false;            // Set by --deterministic
+int coreStates[MAX_CORES];
+bool stopping = false;              // Set when core 0 stops, which tells the rest to stop too
+int turn = 0;                       // The core that is allowed to run when roundRobin is set
+
+// Guards coreStates, stopping, and turn. coreSignal is broadcast whenever one of them changes.
+pthread_mutex_t coreLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t coreSignal = PTHREAD_COND_INITIALIZER;
+
+byte ReadCoreRegister(byte bank, byte address){
+    if(address == CORE_ID){
+        return coreID;
+    }
+    if(address == CORE_COUNT){
+        return coreCount;
+    }
+    byte started = 0;
+    pthread_mutex_lock(&coreLock);
+    for(int core = 0; core < coreCount; core++){
+        if(coreStates[core] != CORE_WAITING){
+            started |= 1 << core;
+        }
+    }
+    pthread_mutex_unlock(&coreLock);
+    return started;
+}
+
+void WriteCoreRegister(byte bank, byte address, byte value){
+    if(address != CORE_START){
+        return;
+    }
+    pthread_mutex_lock(&coreLock);
+    for(int core = 1; core < coreCount; core++){
+        if(((value >> core) & 1) != 0 && coreStates[core] == CORE_WAITING){
+            coreStates[core] = CORE_RUNNING;
+        }
+    }
+    pthread_cond_broadcast(&coreSignal);
+    pthread_mutex_unlock(&coreLock);
+}
+
+// Get the next running core after the given one. coreLock has to be held.
+int NextCore(int core){
+    for(int i = 1; i <= coreCount; i++){
+        int next = (core + i) % coreCount;
+        if(coreStates[next] == CORE_RUNNING){
+            return next;
+        }
+    }
+    return core;
+}
+
+// In deterministic mode, wait until it is this core's turn
+void WaitForTurn(){
+    if(roundRobin == false){
+        return;
+    }
+    pthread_mutex_lock(&coreLock);
+    while(turn != coreID && stopping == false){
+        pthread_cond_wait(&coreSignal, &coreLock);
+    }
+    pthread_mutex_unlock(&coreLock);
+}
+
+// In deterministic mode, let the next core have its turn and wait until it comes back around. Every core does this between its slices.
+void YieldCore(){
+    if(roundRobin == false || coreCount == 1){
+        return;
+    }
+    pthread_mutex_lock(&coreLock);
+    turn = NextCore(coreID);
+    pthread_cond_broadcast(&coreSignal);
+    pthread_mutex_unlock(&coreLock);
+    WaitForTurn();
+}
+#pragma endregion Cores
+
+#pragma region Debug Info
+// The assembler writes program.lst (every instruction with the source line it came from) and program.sym (every label with its bank and address)
+// next to program.bin. If they are there and match the program, traces, profiles and crash dumps say where in the source they are instead of
+// just giving an address.
+#define LISTING_FILE "program.lst"
+#define SYMBOL_FILE "program.sym"
+#define MAX_SYMBOL_LENGTH 64
+#define PROFILE_TOP 20                  // How many of the hottest lines and labels the profile shows
+
+typedef struct {
+    char name[MAX_SYMBOL_LENGTH];
+    word location;                      // Bank in the upper 8 bits and address in the lower 8 bits, the same as PC
+} Symbol;
+
+bool debugInfo = false;                 // True once a listing that matches the loaded program has been read
+char sourceFile[256] = "";              // The asm file the listing came from
+word sourceLine[0x10000];               // The source line of the instruction at each location, 0 if the listing doesn't have one
+bool inserted[0x10000];                 // True if the assembler put the instruction there itself (SOI/SOR for a second operand or a label's bank)
+char* sourceText[0x10000];              // The source line as it was written
+int lastLine = 0;                       // The highest line number in the listing
+Symbol* symbols = NULL;                 // Sorted by location
+int symbolCount = 0;
+
+bool tracing = false;                   // --trace: print every instruction as it executes
+bool profiling = false;                 // --profile: count how many times every instruction executes
+unsigned long long* profile = NULL;     // One count per location when profiling
+
+int CompareSymbols(const void* first, const void* second){
+    return (int)((const Symbol*)first)->location - (int)((const Symbol*)second)->location;
+}
+
+void FreeDebugInfo(){
+    for(int i = 0; i < 0x10000; i++){
+        free(sourceText[i]);
+        sourceText[i] = NULL;
+        sourceLine[i] = 0;
+        inserted[i] = false;
+    }
+    free(symbols);
+    symbols = NULL;
+    symbolCount = 0;
+    lastLine = 0;
+    sourceFile[0] = '\0';
+    debugInfo = false;
+}
+
+// Read the listing and symbol map. Has to be called after the program is loaded since every listing entry is checked against memory. If any of
+// them don't match, program.bin was assembled from something else and the line numbers would be wrong, so none of it is used.
+bool LoadDebugInfo(){
+    FreeDebugInfo();
+    FILE* listing = fopen(LISTING_FILE, "r");
+    if(listing == NULL){
+        return false;
+    }
+
+    char line[512];
+    while(fgets(line, sizeof(line), listing) != NULL){
+        int bank, address, high, low, number, textStart = 0;
+        char mark;
+        char file[256];
+
+        if(line[0] == ';'){
+            // Comment. The first one names the source file.
+            sscanf(line, "; Listing of %255[^\n]", sourceFile);
+            continue;
+        }
+        if(sscanf(line, "%d:%d %x %x %c %255[^:]:%d %n", &bank, &address, &high, &low, &mark, file, &number, &textStart) < 7){
+            continue;
+        }
+        if(bank < 0 || bank >= NUM_BANKS || address < 0 || address >= BANK_SIZE - 1 ||
+           ReadMemory(bank, address) != high || ReadMemory(bank, address + 1) != low){
+            fprintf(stderr, "%s doesn't match program.bin. Reassemble the program to get source lines.\n", LISTING_FILE);
+            fclose(listing);
+            FreeDebugInfo();
+            return false;
+        }
+
+        word location = (bank << 8) | address;
+        line[strcspn(line, "\n")] = '\0';
+        sourceLine[location] = number;
+        inserted[location] = (mark == '+');
+        free(sourceText[location]);
+        sourceText[location] = strdup(textStart > 0 ? line + textStart : "");
+        if(number > lastLine){
+            lastLine = number;
+        }
+    }
+    fclose(listing);
+    debugInfo = true;
+
+    // The symbol map is optional. Without it everything still gets a line number, just no label.
+    FILE* symbolMap = fopen(SYMBOL_FILE, "r");
+    if(symbolMap != NULL){
+        while(fgets(line, sizeof(line), symbolMap) != NULL){
+            Symbol symbol;
+            int bank, address;
+            if(line[0] == ';' || sscanf(line, "%63s %d %d", symbol.name, &bank, &address) != 3){
+                continue;
+            }
+            symbol.location = ((bank & 0xFF) << 8) | (address & 0xFF);
+            Symbol* grown = realloc(symbols, sizeof(Symbol) * (symbolCount + 1));
+            if(grown == NULL){
+                break;
+            }
+            symbols = grown;
+            symbols[symbolCount++] = symbol;
+        }
+        fclose(symbolMap);
+        qsort(symbols, symbolCount, sizeof(Symbol), CompareSymbols);
+    }
+    return true;
+}
+
+// Find the closest label at or before a location. Returns NULL if there isn't one.
+Symbol* FindSymbol(word location){
+    int low = 0;
+    int high = symbolCount - 1;
+    Symbol* found = NULL;
+    while(low <= high){
+        int middle = (low + high) / 2;
+        if(symbols[middle].location <= location){
+            found = &symbols[middle];
+            low = middle + 1;
+        }else{
+            high = middle - 1;
+        }
+    }
+    return found;
+}
+
+// Describe a location as file:line, label+offset, and the source line. Returns a buffer that is reused by the next call.
+const char* DescribeLocation(byte bank, byte address){
+    static char description[512];
+    word location = (bank << 8) | address;
+    int length = 0;
+
+    if(debugInfo == false || sourceLine[location] == 0){
+        snprintf(description, sizeof(description), "%03d:%03d", bank, address);
+        return description;
+    }
+
+    length += snprintf(description + length, sizeof(description) - length, "%03d:%03d %s:%d", bank, address, sourceFile, sourceLine[location]);
+    Symbol* symbol = FindSymbol(location);
+    if(symbol != NULL && length < (int)sizeof(description)){
+        length += snprintf(description + length, sizeof(description) - length, " in %s+%d", symbol->name, location - symbol->location);
+    }
+    if(inserted[location] == true && length < (int)sizeof(description)){
+        length += snprintf(description + length, sizeof(description) - length, " (inserted by the assembler)");
+    }
+    if(length < (int)sizeof(description)){
+        snprintf(description + length, sizeof(description) - length, ": %s", sourceText[location]);
+    }
+    return description;
+}
+
+// Called before every instruction when tracing or profiling
+void RecordInstruction(){
+    word location = (PC[0] << 8) | PC[1];
+    if(profiling == true){
+        profile[location]++;
+    }
+    if(tracing == true){
+        printf("%02x %02x  %s\n", ReadMemory(PC[0], PC[1]), ReadMemory(PC[0], PC[1] + 1), DescribeLocation(PC[0], PC[1]));
+    }
+}
+
+typedef struct {
+    unsigned long long count;
+    int index;
+} ProfileEntry;
+
+int CompareProfileEntries(const void* first, const void* second){
+    unsigned long long a = ((const ProfileEntry*)first)->count;
+    unsigned long long b = ((const ProfileEntry*)second)->count;
+    return (a < b) - (a > b);
+}
+
+// Print where the program spent its time. With a listing, instructions are added up by source line (so a line's inserted SOI/SOR counts
+// towards it) and by label. Without one, it's just the hottest addresses.
+void PrintProfile(){
+    unsigned long long total = 0;
+    int entryCount = debugInfo == true ? lastLine + 1 : 0x10000;
+    ProfileEntry* entries = calloc(entryCount, sizeof(ProfileEntry));
+    ProfileEntry* labelEntries = calloc(symbolCount + 1, sizeof(ProfileEntry));
+    if(entries == NULL || labelEntries == NULL){
+        free(entries);
+        free(labelEntries);
+        return;
+    }
+
+    for(int i = 0; i < entryCount; i++){
+        entries[i].index = i;
+    }
+    for(int i = 0; i <= symbolCount; i++){
+        labelEntries[i].index = i;
+    }
+    for(int location = 0; location < 0x10000; location++){
+        if(profile[location] == 0){
+            continue;
+        }
+        total += profile[location];
+        if(debugInfo == true){
+            entries[sourceLine[location]].count += profile[location];
+            // Anything before the first label goes in the last entry
+            Symbol* symbol = FindSymbol(location);
+            labelEntries[symbol != NULL ? symbol - symbols : symbolCount].count += profile[location];
+        }else{
+            entries[location].count += profile[location];
+        }
+    }
+    if(total == 0){
+        free(entries);
+        free(labelEntries);
+        return;
+    }
+    qsort(entries, entryCount, sizeof(ProfileEntry), CompareProfileEntries);
+    qsort(labelEntries, symbolCount + 1, sizeof(ProfileEntry), CompareProfileEntries);
+
+    printf("\nProfile: %llu instructions\n", total);
+    for(int i = 0; i < entryCount && i < PROFILE_TOP && entries[i].count > 0; i++){
+        double percent = 100.0 * entries[i].count / total;
+        if(debugInfo == false){
+            printf("%6.2f%%  %12llu  %03d:%03d\n", percent, entries[i].count, entries[i].index >> 8, entries[i].index & 0xFF);
+            continue;
+        }
+        if(entries[i].index == 0){
+            // Source lines start at 1, so line 0 is everything that isn't in the listing, like the NOPs past the end of the program
+            printf("%6.2f%%  %12llu  (no source line)\n", percent, entries[i].count);
+            continue;
+        }
+        // Show the source of the first instruction on that line
+        const char* text = "";
+        for(int location = 0; location < 0x10000; location++){
+            if(sourceLine[location] == entries[i].index && sourceText[location] != NULL){
+                text = sourceText[location];
+                break;
+            }
+        }
+        printf("%6.2f%%  %12llu  %s:%d: %s\n", percent, entries[i].count, sourceFile, entries[i].index, text);
+    }
+    if(debugInfo == true && symbolCount > 0){
+        printf("\nBy label:\n");
+        for(int i = 0; i <= symbolCount && i < PROFILE_TOP && labelEntries[i].count > 0; i++){
+            printf("%6.2f%%  %12llu  %s\n", 100.0 * labelEntries[i].count / total, labelEntries[i].count,
+                   labelEntries[i].index < symbolCount ? symbols[labelEntries[i].index].name : "(before the first label)");
+        }
+    }
+    free(entries);
+    free(labelEntries);
+}
+
+#pragma endregion Debug Info
+
 #pragma region methods
 byte* GetRegister(byte code){
     byte* registers[] = { NULL, A_ptr, B_ptr, C_ptr, D_ptr, BI_ptr, P_ptr, S_ptr };
@@ -297,17 +1037,29 @@ void PrintRegisters(){
     printf("DR2: 0x%02x\n", DR2);
     printf("\nPCH: 0x%02x\n", PC[0]);
     printf("PCL: 0x%02x\n", PC[1]);
+    if(debugInfo == true){
+        printf("\nPC is at %s\n", DescribeLocation(PC[0], PC[1]));
+    }
 }
 
 void PrintRAMDebug(int programLength){
     printf("\nProgram Length (In Bytes): %i\n", programLength);
     printf("\nRAM:\n");
     for(int i =0; i < programLength; i++){
-        // For each memory address taken up by the program, print the value at that address. Right now it only does bank 1, but starter programs
-        // likely won't be bigger than that.
-        printf("0x%02x\n", RAM[0].address[i]);
+        // For each memory address taken up by the program, print the value at that address. The program starts at bank 0 and continues into
+        // the banks after it.
+        printf("0x%02x\n", RAM[i / BANK_SIZE]->address[i % BANK_SIZE]);
     }
 }
+
+// If the emulator crashes (usually a bad register ID in the program), say where in the program it happened before dying
+void CrashHandler(int signalNumber){
+    printf("\nCrashed (signal %d)\n", signalNumber);
+    PrintRegisters();
+    fflush(stdout);
+    signal(signalNumber, SIG_DFL);
+    raise(signalNumber);
+}
 #pragma endregion methods
 
 #pragma region Instruction Functions
@@ -316,12 +1068,14 @@ void PrintRAMDebug(int programLength){
 void BankSwitchImmediate(){
     // One operand. Execute before changing P if you are trying to access a different memory bank.
     BI = DR1;
+    bankSwitches++;
     return;
 }
 void BankSwitchRegister(){
     // One operand. If you want to change it to the value in a register, you can.
     byte* registerPointer = GetRegister(DR1);
     BI = (*registerPointer);
+    bankSwitches++;
     return;
 }
 void AddImmediate(){
@@ -361,19 +1115,19 @@ void Copy(){
 }
 void WriteImmediateToP(){
     // One operand
-    RAM[BI].address[P] = DR1;
+    WriteMemory(BI, P, DR1);
     return;
 }
 void WriteRegisterToP(){
     // One operand
     byte* registerPointer = GetRegister(DR1);
-    RAM[BI].address[P] = (*registerPointer);
+    WriteMemory(BI, P, *registerPointer);
     return;
 }
 void GetFromP(){
     // One operand, which is a register
     byte* registerPointer = GetRegister(DR1);
-    (*registerPointer) = RAM[BI].address[P];
+    (*registerPointer) = ReadMemory(BI, P);
 }
 void ShiftLeft(){
     // One operand
@@ -402,7 +1156,7 @@ void JumpRegister(){
     byte* addressRegister = GetRegister(DR1);
     byte* bankRegister = GetRegister(DR2);
     PC[1] = (*addressRegister);
-    PC[2] = (*bankRegister);
+    PC[0] = (*bankRegister);
     JMPFunction = true;
     return;
 }
@@ -450,6 +1204,42 @@ void JumpNotEqualRegister(){
     }
     return;
 }
+void PushReturnAddress(){
+    // The return address is the instruction after the call. Push the bank first, the same way interrupts do.
+    byte address = PC[1] + 2;
+    byte bank = address < 2 ? PC[0] + 1 : PC[0];
+    stack[S] = bank;
+    S++;
+    stack[S] = address;
+    S++;
+}
+void CallImmediate(){
+    // DR1 = address, DR2 = bank
+    PushReturnAddress();
+    PC[1] = DR1;
+    PC[0] = DR2;
+    JMPFunction = true;
+    return;
+}
+void CallRegister(){
+    // DR1 = address register, DR2 = bank register
+    byte* addressRegister = GetRegister(DR1);
+    byte* bankRegister = GetRegister(DR2);
+    PushReturnAddress();
+    PC[1] = (*addressRegister);
+    PC[0] = (*bankRegister);
+    JMPFunction = true;
+    return;
+}
+void Return(){
+    // No operands. Pop the address, then the bank.
+    S--;
+    PC[1] = stack[S];
+    S--;
+    PC[0] = stack[S];
+    JMPFunction = true;
+    return;
+}
 void CompareImmediate(){
     // DR1 = register, DR2 = value to compare
     byte* registerPointer = GetRegister(DR1);
@@ -478,27 +1268,27 @@ void CompareRegister(){
 void ReadImmediate(){
     // DR1 = register, DR2 = address
     byte* registerPointer = GetRegister(DR1);
-    (*registerPointer) = RAM[BI].address[DR2];
+    (*registerPointer) = ReadMemory(BI, DR2);
     return;
 }
 void ReadRegister(){
     // DR1 = load register, DR2 = address register
     byte* load = GetRegister(DR1);
     byte* address = GetRegister(DR2);
-    (*load) = RAM[BI].address[(*address)];
+    (*load) = ReadMemory(BI, *address);
     return;
 }
 void StoreImmediate(){
     // DR1 = register, DR2 = address
     byte* registerPointer = GetRegister(DR1);
-    RAM[BI].address[DR2] = (*registerPointer);
+    WriteMemory(BI, DR2, *registerPointer);
     return;
 }
 void StoreRegister(){
     // DR1 = store register, DR2 = address register
     byte* store = GetRegister(DR1);
     byte* address = GetRegister(DR2);
-    RAM[BI].address[(*address)] = (*store);
+    WriteMemory(BI, *address, *store);
     return;
 }
 void PushImmediate(){
@@ -524,12 +1314,12 @@ void Pop(){
 }
 void IncrementByte(){
     // No operands
-    RAM[BI].address[P]++;
+    WriteMemory(BI, P, ReadMemory(BI, P) + 1);
     return;
 }
 void DecrementByte(){
     // No operands
-    RAM[BI].address[P]--;
+    WriteMemory(BI, P, ReadMemory(BI, P) - 1);
     return;
 }
 void Increment(){
@@ -590,6 +1380,82 @@ void Not(){
     (*registerPointer) = ~(*registerPointer);
     return;
 }
+void Halt(){
+    // No operands. The run loop sleeps until an interrupt arrives.
+    halted = true;
+    return;
+}
+// Get the byte an atomic instruction works on. Device registers don't have one, so NULL means to go through the bus instead.
+byte* AtomicByte(byte bank, byte address){
+    if(bus[bank].read == NULL){
+        return NULL;
+    }
+    byte* memory = WritableBank(bank)->address;
+    RefreshBus(bank);
+    return &memory[address];
+}
+void TestAndSet(){
+    // DR1 = register, DR2 = address. The register gets the old value of the byte, the byte becomes 1, and Equal is set if the byte was 0.
+    byte* registerPointer = GetRegister(DR1);
+    byte* target = AtomicByte(BI, DR2);
+    if(target != NULL){
+        (*registerPointer) = __atomic_exchange_n(target, 1, __ATOMIC_SEQ_CST);
+    }else{
+        (*registerPointer) = ReadMemory(BI, DR2);
+        WriteMemory(BI, DR2, 1);
+    }
+    if(BI >= VRAM_FIRST_BANK){
+        __atomic_store_n(&vramDirty, true, __ATOMIC_RELEASE);
+    }
+    F[EQUAL] = (*registerPointer) == 0;
+    return;
+}
+void CompareAndSwap(){
+    // DR1 = register with the expected value, DR2 = register with the new value. If the byte that P points to holds the expected value, it is
+    // replaced and Equal is set. Either way, the first register ends up with what the byte held.
+    byte* expected = GetRegister(DR1);
+    byte replacement = *GetRegister(DR2);
+    byte* target = AtomicByte(BI, P);
+    if(target != NULL){
+        F[EQUAL] = __atomic_compare_exchange_n(target, expected, replacement, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    }else{
+        byte old = ReadMemory(BI, P);
+        F[EQUAL] = old == (*expected);
+        if(F[EQUAL] == true){
+            WriteMemory(BI, P, replacement);
+        }
+        (*expected) = old;
+    }
+    if(BI >= VRAM_FIRST_BANK){
+        __atomic_store_n(&vramDirty, true, __ATOMIC_RELEASE);
+    }
+    return;
+}
+void EnableInterrupts(){
+    // No operands
+    IME = true;
+    return;
+}
+void DisableInterrupts(){
+    // No operands
+    IME = false;
+    return;
+}
+void ReturnFromInterrupt(){
+    // No operands. Restore the flags and the return address that DispatchInterrupt saved, then turn interrupts back on.
+    S--;
+    F[NEGATIVE] = (stack[S] >> NEGATIVE) & 1;
+    F[CARRY] = (stack[S] >> CARRY) & 1;
+    F[EQUAL] = (stack[S] >> EQUAL) & 1;
+    F[OVERFLOW] = (stack[S] >> OVERFLOW) & 1;
+    S--;
+    PC[1] = stack[S];
+    S--;
+    PC[0] = stack[S];
+    IME = true;
+    JMPFunction = true;
+    return;
+}
 #pragma endregion Instruction Functions
 
 #pragma region Execution
@@ -696,8 +1562,20 @@ void ExecuteInstruction(byte opcode, byte operand){
         JumpNotEqualRegister();
         return;
     }
-    if(ROP == CMPI){
-        CompareImmediate();
+    if(ROP == CALLI){
+        CallImmediate();
+        return;
+    }
+    if(ROP == CALLR){
+        CallRegister();
+        return;
+    }
+    if(ROP == RET){
+        Return();
+        return;
+    }
+    if(ROP == CMPI){
+        CompareImmediate();
         return;
     }
     if(ROP == CMPR){
@@ -779,81 +1657,1264 @@ void ExecuteInstruction(byte opcode, byte operand){
         Not();
         return;
     }
+    // Interrupts
+    if(ROP == HLT){
+        Halt();
+        return;
+    }
+    if(ROP == EI){
+        EnableInterrupts();
+        return;
+    }
+    if(ROP == DI){
+        DisableInterrupts();
+        return;
+    }
+    if(ROP == IRET){
+        ReturnFromInterrupt();
+        return;
+    }
+    // Multi-core
+    if(ROP == TAS){
+        TestAndSet();
+        return;
+    }
+    if(ROP == CAS){
+        CompareAndSwap();
+        return;
+    }
 }
 #pragma endregion Execution
 
 #pragma region Run
 int quit = 0;
 SDL_Event e;
-// Load a program from a given disk (which is an array of instructions) into memory
+
+bool headless = false;              // True when there is no window, like in server mode. Time is counted in instructions instead of real time.
+#define INSTRUCTIONS_PER_MS 1000    // The speed of the CPU when headless, and how fast the cycle counter goes while the CPU is halted
+
+CORE_LOCAL unsigned long long instructionsExecuted = 0; // Only brought up to date at the end of each slice, not after every instruction
+CORE_LOCAL int sliceLength = 0;     // Length of the current slice
+CORE_LOCAL int sliceRemaining = 0;  // Instructions left in the current slice
+unsigned long long instructionLimit = 0;        // Stop after this many instructions. 0 means there is no limit.
+Uint32 idleTime = 0;                // Milliseconds spent halted in headless mode
+CORE_LOCAL unsigned long long idleCycles = 0; // Cycles this core spent halted. The cycle counter keeps going while the CPU sleeps.
+bool sleepingForever = false;       // Set when a halted CPU has nothing that could ever wake it up
+bool limitReached = false;          // Set when a halted CPU used up what was left of the instruction limit
+
+// A key press that is fed to the keyboard once the given number of instructions have been executed. Used instead of SDL events when headless.
+typedef struct {
+    uint32_t at;
+    uint32_t key;
+} ScriptedKey;
+
+ScriptedKey* script = NULL;
+int scriptLength = 0;
+int scriptPosition = 0;
+
+// The banks of the last program that was loaded. Loading the same program again, like the server does for every run of a test, shares these
+// banks instead of making new ones, so the code is only in memory once no matter how many times it is loaded.
+MemoryBank* imageBanks[NUM_BANKS];
+
+// Get a shared bank with the given contents, which are padded with zeros to fill the bank
+MemoryBank* ImageBank(int bank, const byte* code, int length){
+    byte contents[BANK_SIZE] = { 0 };
+    memcpy(contents, code, length);
+    if(imageBanks[bank] == NULL || memcmp(imageBanks[bank]->address, contents, BANK_SIZE) != 0){
+        MemoryBank* memory = NewBank();
+        memcpy(memory->address, contents, BANK_SIZE);
+        AcquireBank(memory);
+        if(imageBanks[bank] != NULL){
+            ReleaseBank(imageBanks[bank]);
+        }
+        imageBanks[bank] = memory;
+    }
+    return imageBanks[bank];
+}
+
+// Load a program from a given disk (which is an array of instructions) into memory. The machine has to have been reset first.
 void LoadProgram(byte disk[], int arrayLen){
-    for(int i = 0; i < arrayLen; i++){
-        if(PC[1] < 256){
-            // If we haven't reached the end of the current memory bank, write to the next byte of RAM
-            RAM[PC[0]].address[PC[1]] = disk[i-(256*PC[0])];
-        }else{
-            PC[0]++;
-            PC[1] = 0;
-            RAM[PC[0]].address[PC[1]] = disk[i-(256*PC[0])];
+    for(int bank = 0; bank * BANK_SIZE < arrayLen; bank++){
+        // Byte i goes into bank i / 256 at address i % 256, which is where the assembler expects it to be
+        int length = arrayLen - bank * BANK_SIZE < BANK_SIZE ? arrayLen - bank * BANK_SIZE : BANK_SIZE;
+        if(bank >= IO_BANK){
+            // Devices have to see what is written to them, so these banks are written one byte at a time
+            for(int i = 0; i < length; i++){
+                WriteMemory(bank, i, disk[bank * BANK_SIZE + i]);
+            }
+            continue;
         }
-        PC[1]++;
+        SetBank(bank, ImageBank(bank, disk + bank * BANK_SIZE, length));
     }
     // Reset the program counter
     PC[0] = 0;
     PC[1] = 0;
 }
 
+#pragma region Hot Reload
+// With --watch, the emulator watches program.bin with inotify and swaps in the new version as soon as it changes, without closing the window.
+// With --watch-asm, it watches the asm file instead and runs the assembler on it first. The program starts over like the emulator was just
+// started, but the window, renderer, and everything else that was set up stays. --keep-ram keeps whatever is in the banks that the program
+// doesn't load into, including VRAM.
+#define PROGRAM_FILE "program.bin"
+#define ASSEMBLER "assembler.py"
+#define RELOAD_DELAY 20             // Milliseconds to wait after the last change, so the assembler can finish writing the listing too
+
+int watchDescriptor = -1;           // The inotify instance, -1 when nothing is watched
+char watchedFile[256] = "";         // Name of the watched file without its directory
+const char* sourceToAssemble = NULL;    // The asm file given to --watch-asm
+bool keepRAM = false;
+bool changed = false;               // The watched file changed and the reload is waiting for RELOAD_DELAY
+Uint32 changedAt = 0;
+bool reloading = false;             // Set when the running program should stop so the new version can be loaded
+
+// Start watching a file. The directory is watched instead of the file itself because editors and the assembler often replace the file instead of
+// writing to it, which would end a watch on the file.
+bool StartWatching(const char* path){
+    char directory[256];
+    const char* name = strrchr(path, '/');
+    if(name == NULL){
+        strcpy(directory, ".");
+        name = path;
+    }else{
+        snprintf(directory, sizeof(directory), "%.*s", (int)(name - path), path);
+        name++;
+    }
+    snprintf(watchedFile, sizeof(watchedFile), "%s", name);
+
+    watchDescriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(watchDescriptor < 0 || inotify_add_watch(watchDescriptor, directory[0] != '\0' ? directory : "/", IN_CLOSE_WRITE | IN_MOVED_TO) < 0){
+        fprintf(stderr, "Error watching %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+// Called with the other devices. Reading a non-blocking inotify descriptor with nothing in it is one system call, so this costs almost nothing.
+void CheckForChanges(){
+    if(watchDescriptor < 0){
+        return;
+    }
+
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t length;
+    while((length = read(watchDescriptor, events, sizeof(events))) > 0){
+        for(char* next = events; next < events + length; next += sizeof(struct inotify_event) + ((struct inotify_event*)next)->len){
+            struct inotify_event* event = (struct inotify_event*)next;
+            if(event->len > 0 && (strcmp(event->name, watchedFile) == 0 || strcmp(event->name, LISTING_FILE) == 0 ||
+                                  strcmp(event->name, SYMBOL_FILE) == 0)){
+                // The listing and symbol map restart the delay too, but they only count if the program itself changed
+                if(strcmp(event->name, watchedFile) == 0){
+                    changed = true;
+                }
+                changedAt = SDL_GetTicks();
+            }
+        }
+    }
+    if(changed == true && SDL_GetTicks() - changedAt >= RELOAD_DELAY){
+        changed = false;
+        reloading = true;
+    }
+}
+
+// Run the assembler on the watched asm file. Returns false if it failed, in which case program.bin wasn't touched.
+bool Reassemble(){
+    pid_t assembler = fork();
+    if(assembler == 0){
+        execlp("python3", "python3", ASSEMBLER, sourceToAssemble, (char*)NULL);
+        _exit(127);
+    }
+    int status;
+    if(assembler < 0 || waitpid(assembler, &status, 0) < 0 || WIFEXITED(status) == false || WEXITSTATUS(status) != 0){
+        fprintf(stderr, "Couldn't assemble %s.\n", sourceToAssemble);
+        return false;
+    }
+    return true;
+}
+
+// Read a program file into a new buffer. Returns NULL if it can't be read.
+byte* ReadProgramFile(const char* name, int* length){
+    FILE* file = fopen(name, "rb");
+    if(file == NULL){
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+    if(size < 0 || size > NUM_BANKS * BANK_SIZE){
+        fclose(file);
+        return NULL;
+    }
+
+    byte* image = malloc(size > 0 ? size : 1);
+    if(image != NULL && fread(image, 1, size, file) != (size_t)size){
+        free(image);
+        image = NULL;
+    }
+    fclose(file);
+    *length = (int)size;
+    return image;
+}
+#pragma endregion Hot Reload
+
+#pragma region Live Stats
+// While the emulator runs, it keeps its stats in a block of POSIX shared memory called /emulator-stats-<pid>, and stats.py shows them live. The
+// emulator is the only writer and never waits for a reader. The block has a sequence number that is odd while the emulator is writing, so a
+// reader copies the block and tries again if the number was odd or changed while it was copying (a seqlock). The stats are collected in
+// collectedStats as things happen and copied into the shared block every STATS_INTERVAL, so the shared memory is only touched 10 times a second.
+// The layout has to match stats.py.
+#define STATS_NAME "/emulator-stats-%d"
+#define STATS_MAGIC 0x53554d45      // "EMUS"
+#define STATS_VERSION 1
+#define STATS_INTERVAL 100000000ull // Nanoseconds between updates of the shared block
+#define FRAME_BUCKETS 16            // Bucket i counts redraws that took less than 2^(i+1) microseconds
+
+typedef struct {
+    uint32_t magic;                 // STATS_MAGIC
+    uint32_t version;               // STATS_VERSION
+    uint64_t sequence;              // Odd while the block is being written
+    uint64_t pid;
+    uint64_t uptime;                // Nanoseconds since the emulator started
+    uint64_t instructions;          // Instructions core 0 has executed
+    uint64_t cycles;                // Instructions plus cycles spent halted, the same as the cycle counter
+    uint64_t mipsNow;               // Thousandths of a MIPS over the last interval
+    uint64_t mipsAverage;           // Thousandths of a MIPS since the emulator started
+    uint64_t idleNow;               // Hundredths of a percent of the last interval that core 0 spent halted
+    uint64_t idleAverage;           // Hundredths of a percent of the time since the emulator started that core 0 spent halted
+    uint64_t vblanks;               // Times the screen was due to be redrawn
+    uint64_t framesDrawn;           // Times it really was redrawn because VRAM had changed
+    uint64_t frameTime[FRAME_BUCKETS];  // How long the redraws took
+    uint64_t polls;                 // Times SDL was polled for events
+    uint64_t pollTime;              // Nanoseconds spent polling
+    uint64_t pollMax;               // Longest poll in nanoseconds
+    uint64_t pc;                    // Core 0's PC, bank << 8 | address
+    uint64_t cores;
+} EmulatorStats;
+
+bool statsEnabled = true;           // Cleared by --no-stats
+EmulatorStats* liveStats = NULL;    // The shared block. NULL when stats are off.
+EmulatorStats collectedStats;
+char statsName[64];
+uint64_t statsStarted = 0;
+uint64_t lastPublished = 0;
+unsigned long long lastInstructions = 0;
+uint64_t idleNanoseconds = 0;       // Real time core 0 has spent halted
+uint64_t idleSince = 0;             // When core 0 halted, or 0 if it's running
+uint64_t lastIdle = 0;
+
+uint64_t NanoTime(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+// Create the shared block. Stats are just left off if it can't be created.
+void OpenStats(){
+    snprintf(statsName, sizeof(statsName), STATS_NAME, (int)getpid());
+    int descriptor = shm_open(statsName, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if(descriptor < 0){
+        fprintf(stderr, "Couldn't create %s for stats: %s\n", statsName, strerror(errno));
+        return;
+    }
+    if(ftruncate(descriptor, sizeof(EmulatorStats)) == 0){
+        void* block = mmap(NULL, sizeof(EmulatorStats), PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+        liveStats = block == MAP_FAILED ? NULL : block;
+    }
+    close(descriptor);
+    if(liveStats == NULL){
+        shm_unlink(statsName);
+        return;
+    }
+
+    memset(&collectedStats, 0, sizeof(collectedStats));
+    collectedStats.magic = STATS_MAGIC;
+    collectedStats.version = STATS_VERSION;
+    collectedStats.pid = getpid();
+    collectedStats.cores = coreCount;
+    statsStarted = NanoTime();
+    lastPublished = statsStarted;
+    memcpy(liveStats, &collectedStats, sizeof(collectedStats));
+}
+
+void CloseStats(){
+    if(liveStats != NULL){
+        munmap(liveStats, sizeof(EmulatorStats));
+        shm_unlink(statsName);
+        liveStats = NULL;
+    }
+}
+
+// Called when the screen is due to be redrawn, with how long DrawToScreen took and whether VRAM had changed
+void RecordRedraw(uint64_t nanoseconds, bool drawn){
+    collectedStats.vblanks++;
+    if(drawn == true){
+        int bucket = 0;
+        while(bucket < FRAME_BUCKETS - 1 && nanoseconds >= (2000ull << bucket)){
+            bucket++;
+        }
+        collectedStats.framesDrawn++;
+        collectedStats.frameTime[bucket]++;
+    }
+}
+
+void RecordPoll(uint64_t nanoseconds){
+    collectedStats.polls++;
+    collectedStats.pollTime += nanoseconds;
+    if(nanoseconds > collectedStats.pollMax){
+        collectedStats.pollMax = nanoseconds;
+    }
+}
+
+// Copy the stats into the shared block if it's time to
+void PublishStats(uint64_t now){
+    if(now - lastPublished < STATS_INTERVAL){
+        return;
+    }
+    uint64_t interval = now - lastPublished;
+    uint64_t elapsed = now - statsStarted;
+    // A long halt is only added to the totals when it ends, so count the part of it so far
+    uint64_t halt = idleSince != 0 ? now - idleSince : 0;
+    uint64_t idle = idleNanoseconds + halt;
+    // Core 0 services the devices, so this is its count including the slice it's in
+    unsigned long long instructions = instructionsExecuted + (sliceLength - sliceRemaining);
+    collectedStats.uptime = elapsed;
+    collectedStats.instructions = instructions;
+    collectedStats.cycles = instructions + idleCycles + halt / 1000000 * INSTRUCTIONS_PER_MS;
+    collectedStats.mipsNow = (instructions - lastInstructions) * 1000000 / interval;
+    collectedStats.mipsAverage = instructions * 1000000 / elapsed;
+    collectedStats.idleNow = (idle - lastIdle) * 10000 / interval;
+    collectedStats.idleAverage = idle * 10000 / elapsed;
+    collectedStats.pc = (PC[0] << 8) | PC[1];
+    lastPublished = now;
+    lastInstructions = instructions;
+    lastIdle = idle;
+
+    uint64_t sequence = liveStats->sequence;
+    __atomic_store_n(&liveStats->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    collectedStats.sequence = sequence + 1;
+    memcpy(liveStats, &collectedStats, sizeof(collectedStats));
+    __atomic_store_n(&liveStats->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+#pragma endregion Live Stats
+
+// Devices are checked every DEVICE_SLICE instructions instead of after every instruction, since polling SDL and redrawing the screen cost far
+// more than executing an instruction.
+#define DEVICE_SLICE 1024
+#define FRAME_TIME 16               // Milliseconds between frames (~60 frames per second). Each frame raises a vblank interrupt.
+
+Uint32 nextFrame = 0;               // When the next frame is due, in ticks
+Uint32 nextTimer = 0;               // When the timer fires next, in ticks
+bool timerRunning = false;
+
+// Get the time in milliseconds. Without a screen nobody is watching in real time, so time is counted in instructions to make runs repeatable.
+Uint32 Ticks(){
+    if(headless == true){
+        return (Uint32)(instructionsExecuted / INSTRUCTIONS_PER_MS) + idleTime;
+    }
+    return SDL_GetTicks();
+}
+
+// Press a key. It is written to the keyboard byte and raises a keyboard interrupt.
+void PressKey(byte key){
+    // Keep it for the keyboard register, which is the last address in the last bank before VRAM. In assembly, you'll have to use its numeric value.
+    __atomic_store_n(&keyboard, key, __ATOMIC_RELEASE);
+    RaiseInterrupt(IRQ_KEYBOARD);
+}
+
+// Handle an SDL event. Quitting sets the quit flag, and key presses are written to the keyboard byte and raise a keyboard interrupt.
+void HandleEvent(SDL_Event* event){
+    if (event->type == SDL_QUIT) {
+        // If it was the command to exit, stop the program.
+        quit = 1;
+    } else if (event->type == SDL_KEYDOWN){
+        // Check for keyboard input
+        SDL_KeyCode keyPressed = event->key.keysym.sym;
+        PressKey(keyPressed);
+    }
+}
+
+// Fire the timer and vblank if they are due and handle any waiting SDL events or scripted key presses
+void ServiceDevices(){
+    // This is the end of core 0's slice, so in deterministic mode the other cores get their turns first
+    YieldCore();
+
+    Uint32 now = Ticks();
+    byte period = __atomic_load_n(&timerPeriod, __ATOMIC_ACQUIRE);
+
+    if(period == 0){
+        // The timer is stopped
+        timerRunning = false;
+    }else if(timerRunning == false){
+        // The timer was just started, so the first tick is one period from now
+        timerRunning = true;
+        nextTimer = now + period;
+    }else if((Sint32)(now - nextTimer) >= 0){
+        RaiseInterrupt(IRQ_TIMER);
+        nextTimer = now + period;
+    }
+
+    if((Sint32)(now - nextFrame) >= 0){
+        if(liveStats != NULL){
+            bool drawn = __atomic_load_n(&vramDirty, __ATOMIC_RELAXED);
+            uint64_t drawStart = NanoTime();
+            DrawToScreen();
+            RecordRedraw(NanoTime() - drawStart, drawn);
+        }else{
+            DrawToScreen();
+        }
+        RaiseInterrupt(IRQ_VBLANK);
+        nextFrame = now + FRAME_TIME;
+    }
+
+    while(scriptPosition < scriptLength && script[scriptPosition].at <= instructionsExecuted){
+        PressKey(script[scriptPosition].key);
+        scriptPosition++;
+    }
+
+    if(headless == false){
+        uint64_t pollStart = liveStats != NULL ? NanoTime() : 0;
+        while (SDL_PollEvent(&e) != 0) {
+            HandleEvent(&e);
+        }
+        if(liveStats != NULL){
+            uint64_t pollEnd = NanoTime();
+            RecordPoll(pollEnd - pollStart);
+            PublishStats(pollEnd);
+        }
+    }
+
+    CheckForChanges();
+}
+
+// Get how many instructions to run before the devices are serviced again. The slice is cut short for the instruction limit and for scripted key
+// presses so that they happen at exactly the right instruction. Returns 0 when the instruction limit has been reached.
+int NextSlice(){
+    unsigned long long length = DEVICE_SLICE;
+    if(instructionLimit != 0 && instructionLimit - instructionsExecuted < length){
+        length = instructionLimit - instructionsExecuted;
+    }
+    if(scriptPosition < scriptLength && script[scriptPosition].at > instructionsExecuted && script[scriptPosition].at - instructionsExecuted < length){
+        length = script[scriptPosition].at - instructionsExecuted;
+    }
+    return (int)length;
+}
+
+// A halted CPU in headless mode doesn't need to wait in real time, so skip straight to whatever would wake it up next. Time spent halted counts
+// against the instruction limit at INSTRUCTIONS_PER_MS, so a program that sleeps between timer ticks can't run forever either.
+void SkipToInterrupt(){
+    Uint32 start = Ticks();
+    while(quit == 0 && InterruptWaiting() == false){
+        byte enabled = __atomic_load_n(&interruptEnable, __ATOMIC_ACQUIRE);
+        Sint32 wait = -1;
+
+        unsigned long long cycles = instructionsExecuted + idleCycles + (unsigned long long)(Ticks() - start) * INSTRUCTIONS_PER_MS;
+        if(instructionLimit != 0 && cycles >= instructionLimit){
+            limitReached = true;
+            quit = 1;
+            return;
+        }
+
+        if((enabled & (1 << IRQ_KEYBOARD)) != 0 && scriptPosition < scriptLength){
+            // Instructions aren't being executed, so the next key press can't be waiting on anything
+            PressKey(script[scriptPosition].key);
+            scriptPosition++;
+            continue;
+        }
+        if((enabled & (1 << IRQ_TIMER)) != 0 && timerRunning == true){
+            wait = (Sint32)(nextTimer - Ticks());
+        }
+        if((enabled & (1 << IRQ_VBLANK)) != 0 && (wait < 0 || (Sint32)(nextFrame - Ticks()) < wait)){
+            wait = (Sint32)(nextFrame - Ticks());
+        }
+        if(wait < 0 && ((enabled & (1 << IRQ_TIMER)) == 0 || timerRunning == false) && (enabled & (1 << IRQ_VBLANK)) == 0){
+            // Nothing can ever wake the CPU up, so the program is done. A stopped timer can't fire, and nothing can start it while halted.
+            sleepingForever = true;
+            quit = 1;
+            return;
+        }
+        if(wait > 0){
+            idleTime += wait;
+        }
+        ServiceDevices();
+    }
+}
+
+// Block the host thread until something can wake the halted CPU. Nothing else happens while halted, so there is no reason to spin.
+void WaitForInterrupt(){
+    Uint32 start = Ticks();
+    idleSince = NanoTime();
+    ServiceDevices();
+    if(headless == true){
+        SkipToInterrupt();
+    }
+    while(quit == 0 && reloading == false && InterruptWaiting() == false){
+        // Sleep until the next SDL event or until the next frame or timer tick, whichever comes first
+        Sint32 timeout = (Sint32)(nextFrame - SDL_GetTicks());
+        if(timerRunning == true && (Sint32)(nextTimer - SDL_GetTicks()) < timeout){
+            timeout = (Sint32)(nextTimer - SDL_GetTicks());
+        }
+        if(timeout > 0 && SDL_WaitEventTimeout(&e, timeout) != 0){
+            HandleEvent(&e);
+        }
+        ServiceDevices();
+    }
+    idleCycles += (unsigned long long)(Ticks() - start) * INSTRUCTIONS_PER_MS;
+    idleNanoseconds += NanoTime() - idleSince;
+    idleSince = 0;
+    halted = false;
+}
+
+// The program keeps running until the user quits, PC runs off the end of the program in bank 0, or a new version of it is ready to be loaded.
+// Code in other banks can run anywhere.
+bool ProgramRunning(int programLength){
+    return quit == 0 && reloading == false && (PC[0] != 0 || PC[1] <= programLength);
+}
+
+// Fetch and execute the instruction that PC points to, then move PC to the next instruction
+void StepInstruction(){
+    ExecuteInstruction(ReadMemory(PC[0], PC[1]), ReadMemory(PC[0], PC[1] + 1));
+    if(JMPFunction == true){
+        JMPFunction = false;
+    }else{
+        PC[1] += 2;
+        if(PC[1] < 2){
+            // If we have gone past the end of the memory bank, continue at the start of the next one
+            PC[0]++;
+        }
+    }
+}
+
 // Execute a program in memory
 void ExecuteProgram(int programLength){
     // Reset the program counter
     PC[0] = 0;
     PC[1] = 0;
 
+    ServiceDevices();
+    sliceLength = NextSlice();
+    sliceRemaining = sliceLength;
+
     // For each instruction in the given program length, execute it.
-    while((PC[0] << 8) | PC[1] <= programLength){
-    //for(int i = 0; i < programLength*2; i++){
-        if(RAM[PC[0]].address[PC[1]] < 255){
-            // If we have not reached address 255, which is the end of a memory bank, continute executing
-            ExecuteInstruction(RAM[PC[0]].address[PC[1]], RAM[PC[0]].address[PC[1]+1]);
-        }else{
-            // If we have reached address 254 or higher, go to the next memory bank and start writing.
-            PC[0]++;
-            PC[1] = 0;
-            ExecuteInstruction(RAM[PC[0]].address[PC[1]], RAM[PC[0]].address[PC[1]+1]);
+    while(sliceRemaining > 0 && ProgramRunning(programLength)){
+        if(halted == true){
+            // HLT was executed. Sleep until an interrupt comes in.
+            WaitForInterrupt();
+            continue;
         }
-        if(JMPFunction == true){
-            JMPFunction = false;
-        }else{
-            PC[1] += 2;
+        if(IME == true && ROP != SOI && ROP != SOR && InterruptWaiting() == true){
+            // Take the interrupt. Never do it right after SOI/SOR since their instruction still needs DR2.
+            DispatchInterrupt();
+        }
+        if(tracing == true || profiling == true){
+            RecordInstruction();
         }
 
-        while (SDL_PollEvent(&e) != 0) {
-            // Check if there was an SDL event
-            if (e.type == SDL_QUIT) {
-                // If it was the command to exit, stop the program.
-                return;
-            } else if (e.type == SDL_KEYDOWN){
-                // Check for keyboard input
-                SDL_KeyCode keyPressed = e.key.keysym.sym;
-
-                // Store it in the last address in the last bank before VRAM. In assembly, you'll have to use its numeric value. For some reason, the next
-                // Address is read by VRAM.
-                RAM[250].address[254] = keyPressed;
+        StepInstruction();
+
+        sliceRemaining--;
+        if(sliceRemaining == 0){
+            instructionsExecuted += sliceLength;
+            ServiceDevices();
+            sliceLength = NextSlice();
+            sliceRemaining = sliceLength;
+        }
+    }
+    instructionsExecuted += sliceLength - sliceRemaining;
+    sliceLength = 0;
+    sliceRemaining = 0;
+}
+
+#pragma region Running Cores
+pthread_t coreThreads[MAX_CORES];
+int coreProgramLength = 0;          // The length of the program the cores are running
+// program_aot sets this so that it finds out when the other cores write to its compiled code. They only run in the interpreter, so it is
+// called after each of their instructions. Core 0 checks its own writes.
+void (*interpretedWriteHook)(void) = NULL;
+
+// The thread of every core except core 0, which runs on the main thread. Waits until the core is started, then runs it a slice at a time.
+void* RunCore(void* argument){
+    coreID = (int)(intptr_t)argument;
+
+    pthread_mutex_lock(&coreLock);
+    while(coreStates[coreID] == CORE_WAITING && stopping == false){
+        pthread_cond_wait(&coreSignal, &coreLock);
+    }
+    pthread_mutex_unlock(&coreLock);
+
+    PC[1] = ReadMemory(IO_BANK, CORE_ENTRY_TABLE + coreID * 2);
+    PC[0] = ReadMemory(IO_BANK, CORE_ENTRY_TABLE + coreID * 2 + 1);
+    WaitForTurn();
+    while(__atomic_load_n(&stopping, __ATOMIC_ACQUIRE) == false && halted == false && (PC[0] != 0 || PC[1] <= coreProgramLength)){
+        sliceLength = DEVICE_SLICE;
+        for(sliceRemaining = sliceLength; sliceRemaining > 0 && halted == false && (PC[0] != 0 || PC[1] <= coreProgramLength); sliceRemaining--){
+            StepInstruction();
+            if(interpretedWriteHook != NULL){
+                interpretedWriteHook();
             }
         }
-        DrawToScreen();
+        instructionsExecuted += sliceLength - sliceRemaining;
+        sliceLength = 0;
+        sliceRemaining = 0;
+        YieldCore();
     }
+
+    // Done. If this core had the baton, pass it on.
+    pthread_mutex_lock(&coreLock);
+    coreStates[coreID] = CORE_FINISHED;
+    if(turn == coreID){
+        turn = NextCore(coreID);
+    }
+    pthread_cond_broadcast(&coreSignal);
+    pthread_mutex_unlock(&coreLock);
+    return NULL;
+}
+
+// Start a thread for every core other than core 0. They wait until the program starts them.
+void StartCores(int programLength){
+    if(coreCount == 1){
+        return;
+    }
+    coreProgramLength = programLength;
+    stopping = false;
+    turn = 0;
+    coreStates[0] = CORE_RUNNING;
+    for(int core = 1; core < coreCount; core++){
+        coreStates[core] = CORE_WAITING;
+    }
+
+    // Copying a shared bank while another core is using it isn't safe, so give the machine its own copy of every bank before any core starts
+    for(int bank = 0; bank < NUM_BANKS; bank++){
+        WritableBank(bank);
+        RefreshBus(bank);
+    }
+
+    for(int core = 1; core < coreCount; core++){
+        if(pthread_create(&coreThreads[core], NULL, RunCore, (void*)(intptr_t)core) != 0){
+            fprintf(stderr, "Error starting core %d.\n", core);
+            exit(1);
+        }
+    }
+}
+
+// Stop the other cores once core 0 is done and wait for their threads to finish
+void StopCores(){
+    if(coreCount == 1){
+        return;
+    }
+    pthread_mutex_lock(&coreLock);
+    __atomic_store_n(&stopping, true, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&coreSignal);
+    pthread_mutex_unlock(&coreLock);
+    for(int core = 1; core < coreCount; core++){
+        pthread_join(coreThreads[core], NULL);
+    }
+}
+#pragma endregion Running Cores
+
+#pragma region Performance Counters
+// The performance counters let a program time itself. They are memory mapped into the I/O bank as four 32-bit counters with the low byte first.
+// Writing anything to the latch register copies all of them at once, so a counter can't change halfway through being read.
+#define COUNTER_LATCH 236
+#define COUNTER_CYCLES 237          // Addresses 237-240. Instructions plus the time spent halted, both for the core that latches.
+#define COUNTER_INSTRUCTIONS 241    // Addresses 241-244. Instructions executed, including SOI/SOR.
+#define COUNTER_BANK_SWITCHES 245   // Addresses 245-248. BSWCHI/BSWCHR instructions executed.
+#define COUNTER_FRAMES 249          // Addresses 249-252. Frames drawn because VRAM changed.
+
+CORE_LOCAL byte latchedCounters[16];
+
+// The instruction count is only updated once per slice, so add what has been done in the current slice
+unsigned long long InstructionCount(){
+    return instructionsExecuted + (sliceLength - sliceRemaining);
 }
+
+void LatchCounters(byte bank, byte address, byte value){
+    uint32_t counters[4];
+    counters[0] = (uint32_t)(InstructionCount() + idleCycles);
+    counters[1] = (uint32_t)InstructionCount();
+    counters[2] = (uint32_t)bankSwitches;
+    counters[3] = (uint32_t)framesPresented;
+    for(int i = 0; i < 16; i++){
+        latchedCounters[i] = (counters[i / 4] >> ((i % 4) * 8)) & 0xFF;
+    }
+}
+
+byte ReadCounter(byte bank, byte address){
+    return latchedCounters[address - COUNTER_CYCLES];
+}
+#pragma endregion Performance Counters
+
+// Put every device on the bus
+void ConnectDevices(){
+    ResetBus();
+    MapDevice(VRAM_FIRST_BANK, VRAM_LAST_BANK, NULL, WriteVRAM);
+    MapRegisters(INT_ENABLE, TIMER_PERIOD, ReadInterruptRegister, WriteInterruptRegister);
+    MapRegisters(KEYBOARD_ADDRESS, KEYBOARD_ADDRESS, ReadKeyboard, WriteKeyboard);
+    MapRegisters(COUNTER_LATCH, COUNTER_LATCH, ReadNothing, LatchCounters);
+    MapRegisters(COUNTER_CYCLES, COUNTER_FRAMES + 3, ReadCounter, WriteNothing);
+    MapRegisters(CORE_ID, CORE_COUNT, ReadCoreRegister, WriteNothing);
+    MapRegisters(CORE_START, CORE_START, ReadCoreRegister, WriteCoreRegister);
+}
+
+// Put the whole machine back to the way it is when the emulator starts
+void ResetMachine(){
+    for(int bank = 0; bank < NUM_BANKS; bank++){
+        SetBank(bank, &zeroBank);
+    }
+    memset(stack, 0, sizeof(stack));
+    memset(F, 0, sizeof(F));
+    A = 0;
+    B = 0;
+    C = 0;
+    D = 0;
+    P = 0;
+    BI = 0;
+    S = 0;
+    PC[0] = 0;
+    PC[1] = 0;
+    ROP = 0;
+    DR1 = 0;
+    DR2 = 0;
+    IME = false;
+    halted = false;
+    JMPFunction = false;
+    quit = 0;
+    nextFrame = 0;
+    nextTimer = 0;
+    timerRunning = false;
+    instructionsExecuted = 0;
+    instructionLimit = 0;
+    idleTime = 0;
+    sleepingForever = false;
+    limitReached = false;
+    script = NULL;
+    scriptLength = 0;
+    scriptPosition = 0;
+    interruptEnable = 0;
+    interruptPending = 0;
+    timerPeriod = 0;
+    keyboard = 0;
+    vramDirty = true;
+    sliceLength = 0;
+    sliceRemaining = 0;
+    idleCycles = 0;
+    bankSwitches = 0;
+    framesPresented = 0;
+    memset(latchedCounters, 0, sizeof(latchedCounters));
+    ConnectDevices();
+}
+
+// Swap in the new version of the program. Everything is reset like the emulator was just started, except that with --keep-ram the banks that
+// neither version of the program loads into keep what they had. Returns false and leaves the machine alone if the new version can't be loaded.
+bool ReloadProgram(int* programLength){
+    RAMSnapshot saved;
+    Uint32 start = SDL_GetTicks();
+    int length;
+
+    reloading = false;
+    if(sourceToAssemble != NULL && Reassemble() == false){
+        return false;
+    }
+    byte* image = ReadProgramFile(PROGRAM_FILE, &length);
+    if(image == NULL){
+        fprintf(stderr, "Couldn't read %s.\n", PROGRAM_FILE);
+        return false;
+    }
+
+    int codeBanks = ((length > *programLength ? length : *programLength) + BANK_SIZE - 1) / BANK_SIZE;
+    if(keepRAM == true){
+        SaveRAM(&saved);
+    }
+    ResetMachine();
+    if(keepRAM == true){
+        RestoreRAM(&saved, codeBanks, NUM_BANKS - 1);
+        FreeSnapshot(&saved);
+    }
+    LoadProgram(image, length);
+    free(image);
+    *programLength = length;
+
+    // The old line numbers and counts don't mean anything for the new version
+    LoadDebugInfo();
+    if(profiling == true){
+        memset(profile, 0, 0x10000 * sizeof(unsigned long long));
+    }
+    printf("Reloaded %s (%d bytes) in %u ms\n", PROGRAM_FILE, length, SDL_GetTicks() - start);
+    return true;
+}
+
+// When a watched program stops, load the next version of it. If it finished on its own, the window stays open until the next version shows up.
+// Returns false if the user quit instead.
+bool LoadNextVersion(int* programLength){
+    while(quit == 0){
+        if(reloading == false){
+            PrintRegisters();
+            printf("Waiting for %s to change.\n", watchedFile);
+        }
+        while(quit == 0 && reloading == false){
+            if(SDL_WaitEventTimeout(&e, RELOAD_DELAY) != 0){
+                HandleEvent(&e);
+            }
+            CheckForChanges();
+        }
+        if(reloading == true && ReloadProgram(programLength) == true){
+            return true;
+        }
+    }
+    return false;
+}
+
+#ifdef AOT_RUNTIME
+// Provided by the C file that recompiler.py generates. It runs the compiled blocks and falls back to StepInstruction for anything else.
+void ExecuteCompiled(int programLength);
+#endif
 #pragma endregion Run
 
 #pragma endregion CPU
 
 #pragma endregion Computer
 
+#pragma region Benchmark
+// The memory bus benchmark. It shows that plain RAM costs the same no matter how many devices are on the bus, first with a loop that only reads
+// and writes RAM, and then with a program running in the interpreter. Run it with: emulator --bench-bus
+#define BENCHMARK_ACCESSES 200000000
+#define BENCHMARK_INSTRUCTIONS 100000000
+#define BENCHMARK_COPIES 100000
+
+// The program the interpreter runs. It switches to bank 1, then stores and loads every address of the bank forever.
+// BSWCHI, 1 / _loop: STORR, B, B / LOADR, A, B / INCR, B / JMPI, _loop
+byte benchmarkProgram[] = { 0x26, 0x01, 0x81, 0x02, 0x15, 0x02, 0x81, 0x02, 0x13, 0x01, 0x1b, 0x02, 0x80, 0x00, 0x0a, 0x02 };
+
+// Read and write banks 0-63 without the bus, the way it was done before there was a bus. Returns nanoseconds per access.
+double TimeDirectAccesses(){
+    for(int bank = 0; bank < 64; bank++){
+        WritableBank(bank);
+    }
+    uint64_t start = NanoTime();
+    for(uint32_t i = 0; i < BENCHMARK_ACCESSES / 2; i++){
+        byte bank = (i >> 8) & 0x3F;
+        byte address = i * 7;
+        RAM[bank]->address[address] = RAM[bank]->address[address] + 1;
+    }
+    return (double)(NanoTime() - start) / BENCHMARK_ACCESSES;
+}
+
+// The same accesses through the bus
+double TimeBusAccesses(){
+    uint64_t start = NanoTime();
+    for(uint32_t i = 0; i < BENCHMARK_ACCESSES / 2; i++){
+        byte bank = (i >> 8) & 0x3F;
+        byte address = i * 7;
+        WriteMemory(bank, address, ReadMemory(bank, address) + 1);
+    }
+    return (double)(NanoTime() - start) / BENCHMARK_ACCESSES;
+}
+
+// Run the benchmark program in the interpreter. Returns millions of instructions per second.
+double TimeInterpreter(){
+    LoadProgram(benchmarkProgram, sizeof(benchmarkProgram));
+    instructionLimit = BENCHMARK_INSTRUCTIONS;
+    uint64_t start = NanoTime();
+    ExecuteProgram(0x10000);
+    uint64_t elapsed = NanoTime() - start;
+    return (double)instructionsExecuted * 1000.0 / elapsed;
+}
+
+// Copy all of RAM by taking a snapshot of the bank table. Returns nanoseconds per copy.
+double TimeSnapshots(){
+    RAMSnapshot snapshot;
+    uint64_t start = NanoTime();
+    for(int i = 0; i < BENCHMARK_COPIES; i++){
+        SaveRAM(&snapshot);
+        FreeSnapshot(&snapshot);
+    }
+    return (double)(NanoTime() - start) / BENCHMARK_COPIES;
+}
+
+// Copy all of RAM byte for byte, which is what a copy of the machine took before banks could be shared. Returns nanoseconds per copy.
+double TimeFullCopies(){
+    static byte copy[NUM_BANKS][BANK_SIZE];
+    uint64_t start = NanoTime();
+    for(int i = 0; i < BENCHMARK_COPIES; i++){
+        for(int bank = 0; bank < NUM_BANKS; bank++){
+            memcpy(copy[bank], RAM[bank]->address, BANK_SIZE);
+        }
+        __asm__ volatile("" : : "r"(copy) : "memory");     // Don't let the compiler skip the copies
+    }
+    return (double)(NanoTime() - start) / BENCHMARK_COPIES;
+}
+
+int BenchmarkBus(){
+    headless = true;
+
+    ResetMachine();
+    ResetBus();
+    printf("No devices:                RAM without the bus %.3f ns, through the bus %.3f ns, interpreter %.1f MIPS\n",
+        TimeDirectAccesses(), TimeBusAccesses(), TimeInterpreter());
+
+    ResetMachine();
+    printf("Keyboard, timer, and VRAM: RAM without the bus %.3f ns, through the bus %.3f ns, interpreter %.1f MIPS\n",
+        TimeDirectAccesses(), TimeBusAccesses(), TimeInterpreter());
+
+    ResetMachine();
+    MapDevice(64, IO_BANK - 1, ReadNothing, WriteNothing);     // Fake devices on every bank the benchmark doesn't use
+    printf("186 more devices:          RAM without the bus %.3f ns, through the bus %.3f ns, interpreter %.1f MIPS\n",
+        TimeDirectAccesses(), TimeBusAccesses(), TimeInterpreter());
+
+    ResetMachine();
+    LoadProgram(benchmarkProgram, sizeof(benchmarkProgram));
+    for(int bank = 1; bank < 64; bank++){
+        WritableBank(bank);
+    }
+    double snapshot = TimeSnapshots();
+    int privateBanks, sharedBanks;
+    CountBanks(&privateBanks, &sharedBanks);
+    printf("Copying RAM with %d private banks and %d shared: bank table %.0f ns, every byte %.0f ns\n", privateBanks, sharedBanks,
+        snapshot, TimeFullCopies());
+    return 0;
+}
+#pragma endregion Benchmark
+
+#pragma region Server
+// Server mode keeps the emulator running so that programs can be sent to it over a Unix socket, without starting a new process and opening a
+// window for every run. Each worker process has its own machine and resets it right after a run, so the next run can start as soon as it arrives.
+// The machine is all global variables, so the workers are processes instead of threads.
+//
+// A client sends a ServerRequest, followed by the program image and then scriptLength ScriptedKeys. It gets back a RunResponse. A ServerRequest
+// with the type REQUEST_STATS gets a StatsResponse instead.
+#define DEFAULT_SOCKET "/tmp/emulator.sock"
+#define DEFAULT_WORKERS 4
+#define DEFAULT_QUEUE_DEPTH 64
+#define MAX_SCRIPT_LENGTH 4096
+#define MAX_INSTRUCTIONS 1000000000ull  // The most any run can take, even with no limit, so a program that never ends can't keep a worker forever
+#define CLIENT_TIMEOUT 5            // Seconds a worker waits for a client to send the rest of its request before giving up on it
+#define LATENCY_BUCKETS 40          // Bucket i counts runs that took less than 2^(i+1) microseconds
+
+enum RequestTypes { REQUEST_RUN = 1, REQUEST_STATS = 2 };
+enum RunResults { RESULT_FINISHED, RESULT_LIMIT_REACHED, RESULT_HALTED, RESULT_BAD_REQUEST };
+
+typedef struct {
+    uint32_t type;                  // REQUEST_RUN or REQUEST_STATS
+    uint32_t imageLength;           // Bytes of program image after the request. At most 64kb.
+    uint32_t scriptLength;          // Number of ScriptedKeys after the image
+    uint32_t reserved;
+    uint64_t instructionLimit;      // Stop after this many instructions. 0 means as many as the server allows (MAX_INSTRUCTIONS).
+} ServerRequest;
+
+typedef struct {
+    uint64_t instructions;          // Instructions executed
+    uint64_t nanoseconds;           // Time spent running the program
+    uint64_t ramDigest;             // FNV-1a hash of banks 0-250
+    uint64_t vramDigest;            // FNV-1a hash of the VRAM banks, 251-255
+    uint32_t result;                // How the run ended. One of RunResults.
+    byte registers[12];             // A, B, C, D, P, BI, S, PC bank, PC address, flags, and two bytes of padding
+    uint32_t privateBanks;          // Banks of RAM the run had to itself at the end, which is what the run cost in memory
+    uint32_t sharedBanks;           // Banks still shared with the program image
+} RunResponse;
+
+typedef struct {
+    uint64_t uptime;                // Nanoseconds since the server started
+    uint64_t runs;                  // Runs that finished or halted. Only these are counted in the instructions, busy time, and latency.
+    uint64_t errors;                // Requests that were malformed or never arrived in full
+    uint64_t timeouts;              // Runs stopped by their instruction limit or MAX_INSTRUCTIONS
+    uint64_t instructions;          // Instructions executed by all workers
+    uint64_t busyTime;              // Nanoseconds the workers spent on runs
+    uint64_t p50;                   // Median run latency in microseconds
+    uint64_t p99;                   // 99th percentile run latency in microseconds
+    uint32_t workers;
+    uint32_t queueDepth;
+} StatsResponse;
+
+// Shared between the workers so that any of them can answer a stats request
+typedef struct {
+    uint64_t started;
+    uint64_t runs;
+    uint64_t errors;
+    uint64_t timeouts;
+    uint64_t instructions;
+    uint64_t busyTime;
+    uint64_t latency[LATENCY_BUCKETS];
+    uint32_t workers;
+    uint32_t queueDepth;
+} ServerStats;
+
+ServerStats* serverStats = NULL;
+
+// FNV-1a hash of a range of banks
+uint64_t DigestBanks(int first, int last){
+    uint64_t digest = 14695981039346656037ull;
+    for(int bank = first; bank <= last; bank++){
+        for(int address = 0; address < BANK_SIZE; address++){
+            digest = (digest ^ RAM[bank]->address[address]) * 1099511628211ull;
+        }
+    }
+    return digest;
+}
+
+// Read or write exactly length bytes. Returns false if the client went away.
+bool ReadAll(int client, void* buffer, size_t length){
+    byte* position = buffer;
+    while(length > 0){
+        ssize_t count = read(client, position, length);
+        if(count < 0 && errno == EINTR){
+            continue;
+        }
+        if(count <= 0){
+            return false;
+        }
+        position += count;
+        length -= count;
+    }
+    return true;
+}
+bool WriteAll(int client, const void* buffer, size_t length){
+    const byte* position = buffer;
+    while(length > 0){
+        ssize_t count = write(client, position, length);
+        if(count < 0 && errno == EINTR){
+            continue;
+        }
+        if(count <= 0){
+            return false;
+        }
+        position += count;
+        length -= count;
+    }
+    return true;
+}
+
+// Run a program for a client. The machine was already reset after the last run. Returns how the run ended, which is RESULT_BAD_REQUEST if
+// the rest of the request never arrived.
+uint32_t RunRequest(int client, ServerRequest* request){
+    static byte image[NUM_BANKS * BANK_SIZE];
+    static ScriptedKey keys[MAX_SCRIPT_LENGTH];
+    RunResponse response;
+    memset(&response, 0, sizeof(response));
+
+    if(request->imageLength > sizeof(image) || request->scriptLength > MAX_SCRIPT_LENGTH){
+        response.result = RESULT_BAD_REQUEST;
+        WriteAll(client, &response, sizeof(response));
+        return response.result;
+    }
+    if(ReadAll(client, image, request->imageLength) == false || ReadAll(client, keys, request->scriptLength * sizeof(ScriptedKey)) == false){
+        return RESULT_BAD_REQUEST;
+    }
+
+    uint64_t start = NanoTime();
+    LoadProgram(image, request->imageLength);
+    script = keys;
+    scriptLength = request->scriptLength;
+    instructionLimit = request->instructionLimit;
+    if(instructionLimit == 0 || instructionLimit > MAX_INSTRUCTIONS){
+        instructionLimit = MAX_INSTRUCTIONS;
+    }
+    ExecuteProgram(request->imageLength);
+    response.nanoseconds = NanoTime() - start;
+
+    if(limitReached == true || (instructionLimit != 0 && instructionsExecuted >= instructionLimit)){
+        response.result = RESULT_LIMIT_REACHED;
+    }else if(sleepingForever == true){
+        response.result = RESULT_HALTED;
+    }else{
+        response.result = RESULT_FINISHED;
+    }
+    response.instructions = instructionsExecuted;
+    response.ramDigest = DigestBanks(0, 250);
+    response.vramDigest = DigestBanks(251, 255);
+    byte registers[] = { A, B, C, D, P, BI, S, PC[0], PC[1], PackFlags() };
+    memcpy(response.registers, registers, sizeof(registers));
+    int privateBanks, sharedBanks;
+    CountBanks(&privateBanks, &sharedBanks);
+    response.privateBanks = privateBanks;
+    response.sharedBanks = sharedBanks;
+    WriteAll(client, &response, sizeof(response));
+    return response.result;
+}
+
+// Answer a stats request from the counters that all of the workers share
+void StatsRequest(int client){
+    StatsResponse response;
+    memset(&response, 0, sizeof(response));
+    response.uptime = NanoTime() - serverStats->started;
+    response.runs = __atomic_load_n(&serverStats->runs, __ATOMIC_RELAXED);
+    response.errors = __atomic_load_n(&serverStats->errors, __ATOMIC_RELAXED);
+    response.timeouts = __atomic_load_n(&serverStats->timeouts, __ATOMIC_RELAXED);
+    response.instructions = __atomic_load_n(&serverStats->instructions, __ATOMIC_RELAXED);
+    response.busyTime = __atomic_load_n(&serverStats->busyTime, __ATOMIC_RELAXED);
+    response.workers = serverStats->workers;
+    response.queueDepth = serverStats->queueDepth;
+
+    // Find the buckets that the median and the 99th percentile fall into. The reported latency is the top of the bucket.
+    uint64_t total = 0;
+    uint64_t counts[LATENCY_BUCKETS];
+    for(int i = 0; i < LATENCY_BUCKETS; i++){
+        counts[i] = __atomic_load_n(&serverStats->latency[i], __ATOMIC_RELAXED);
+        total += counts[i];
+    }
+    uint64_t seen = 0;
+    for(int i = 0; i < LATENCY_BUCKETS && total > 0; i++){
+        seen += counts[i];
+        if(response.p50 == 0 && seen * 2 >= total){
+            response.p50 = 1ull << (i + 1);
+        }
+        if(seen * 100 >= total * 99){
+            response.p99 = 1ull << (i + 1);
+            break;
+        }
+    }
+    WriteAll(client, &response, sizeof(response));
+}
+
+// The loop each worker runs. Wait for a client, run its program, then reset the machine before waiting again.
+void ServeClients(int server){
+    ResetMachine();
+    headless = true;
+    while(true){
+        int client = accept(server, NULL, NULL);
+        if(client < 0){
+            continue;
+        }
+        // Don't let a client that connects and never sends anything keep the worker
+        struct timeval timeout = { CLIENT_TIMEOUT, 0 };
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        uint64_t start = NanoTime();
+        ServerRequest request;
+        if(ReadAll(client, &request, sizeof(request)) == false || (request.type != REQUEST_STATS && request.type != REQUEST_RUN)){
+            __atomic_add_fetch(&serverStats->errors, 1, __ATOMIC_RELAXED);
+        }else if(request.type == REQUEST_STATS){
+            StatsRequest(client);
+        }else{
+            // Only runs that ended on their own go into the latency and throughput. Runs that were cut off would make both look like the
+            // instruction limit instead of the programs.
+            uint32_t result = RunRequest(client, &request);
+            if(result == RESULT_BAD_REQUEST){
+                __atomic_add_fetch(&serverStats->errors, 1, __ATOMIC_RELAXED);
+            }else if(result == RESULT_LIMIT_REACHED){
+                __atomic_add_fetch(&serverStats->timeouts, 1, __ATOMIC_RELAXED);
+            }else{
+                uint64_t elapsed = NanoTime() - start;
+                int bucket = 0;
+                while(bucket < LATENCY_BUCKETS - 1 && (elapsed / 1000) >= (1ull << (bucket + 1))){
+                    bucket++;
+                }
+                __atomic_add_fetch(&serverStats->runs, 1, __ATOMIC_RELAXED);
+                __atomic_add_fetch(&serverStats->instructions, instructionsExecuted, __ATOMIC_RELAXED);
+                __atomic_add_fetch(&serverStats->busyTime, elapsed, __ATOMIC_RELAXED);
+                __atomic_add_fetch(&serverStats->latency[bucket], 1, __ATOMIC_RELAXED);
+            }
+            ResetMachine();
+        }
+        close(client);
+    }
+}
+
+// Start the server. The main process only keeps the workers running. If one of them dies, it is replaced.
+int Serve(const char* path, int workers, int queueDepth){
+    signal(SIGPIPE, SIG_IGN);
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    unlink(path);
+    if(server < 0 || bind(server, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(server, queueDepth) != 0){
+        fprintf(stderr, "Error opening socket %s.\n", path);
+        return 1;
+    }
+
+    serverStats = mmap(NULL, sizeof(ServerStats), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(serverStats == MAP_FAILED){
+        fprintf(stderr, "Error allocating memory for server stats.\n");
+        return 1;
+    }
+    memset(serverStats, 0, sizeof(ServerStats));
+    serverStats->started = NanoTime();
+    serverStats->workers = workers;
+    serverStats->queueDepth = queueDepth;
+
+    printf("Serving on %s with %i workers.\n", path, workers);
+    fflush(stdout);
+
+    int running = 0;
+    while(true){
+        while(running < workers){
+            pid_t worker = fork();
+            if(worker == 0){
+                ServeClients(server);
+            }else if(worker > 0){
+                running++;
+            }else{
+                fprintf(stderr, "Error starting a worker.\n");
+                return 1;
+            }
+        }
+        if(wait(NULL) > 0){
+            running--;
+        }
+    }
+}
+#pragma endregion Server
+
 int main(int argc, char* argv[]){
+    if(argc > 1 && strcmp(argv[1], "--bench-bus") == 0){
+        return BenchmarkBus();
+    }
+    if(argc > 1 && strcmp(argv[1], "--serve") == 0){
+        // Usage: emulator --serve [socket path] [workers] [queue depth]
+        const char* path = argc > 2 ? argv[2] : DEFAULT_SOCKET;
+        int workers = argc > 3 ? atoi(argv[3]) : DEFAULT_WORKERS;
+        int queueDepth = argc > 4 ? atoi(argv[4]) : DEFAULT_QUEUE_DEPTH;
+        if(workers < 1 || queueDepth < 1){
+            fprintf(stderr, "Error: there has to be at least one worker and a queue depth of at least one.\n");
+            return 1;
+        }
+        return Serve(path, workers, queueDepth);
+    }
+    for(int i = 1; i < argc; i++){
+        // Usage: emulator [--trace] [--profile] [--watch | --watch-asm file.asm] [--keep-ram] [--cores N] [--deterministic] [--no-stats]
+        if(strcmp(argv[i], "--trace") == 0){
+            tracing = true;
+        }else if(strcmp(argv[i], "--profile") == 0){
+            profiling = true;
+        }else if(strcmp(argv[i], "--watch") == 0){
+            if(StartWatching(PROGRAM_FILE) == false){
+                return 1;
+            }
+        }else if(strcmp(argv[i], "--watch-asm") == 0 && i + 1 < argc){
+            sourceToAssemble = argv[++i];
+            if(StartWatching(sourceToAssemble) == false || Reassemble() == false){
+                return 1;
+            }
+        }else if(strcmp(argv[i], "--keep-ram") == 0){
+            keepRAM = true;
+        }else if(strcmp(argv[i], "--cores") == 0 && i + 1 < argc){
+            coreCount = atoi(argv[++i]);
+            if(coreCount < 1 || coreCount > MAX_CORES){
+                fprintf(stderr, "Error: there can be 1 to %d cores.\n", MAX_CORES);
+                return 1;
+            }
+        }else if(strcmp(argv[i], "--deterministic") == 0){
+            roundRobin = true;
+        }else if(strcmp(argv[i], "--no-stats") == 0){
+            statsEnabled = false;
+        }else{
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if(profiling == true){
+        profile = calloc(0x10000, sizeof(unsigned long long));
+        if(profile == NULL){
+            fprintf(stderr, "Error allocating memory for the profile.\n");
+            return 1;
+        }
+    }
+
     // Open the program file
     FILE *file;
-    byte *ROM;
+    byte *ROM = NULL;
     word file_size;
     file = fopen("program.bin", "rb");
 
@@ -863,13 +2924,6 @@ int main(int argc, char* argv[]){
         return 1;
     }
 
-    if (ROM == NULL) {
-        fprintf(stderr, "Error allocating memory for ROM.\n");
-        fclose(file);
-        return 1;
-    }
-
-
     // Look for the file
     fseek(file, 0, SEEK_END);
     file_size = ftell(file);            // Get the size of the file
@@ -877,6 +2931,12 @@ int main(int argc, char* argv[]){
 
     ROM = (byte *)malloc(file_size);    // Get an array of bytes based on the size of the file
 
+    if (ROM == NULL) {
+        fprintf(stderr, "Error allocating memory for ROM.\n");
+        fclose(file);
+        return 1;
+    }
+
     fread(ROM, 1, file_size, file);     // Read the file and write its data to the ROM
 
     // Get the length of the ROM array
@@ -884,16 +2944,48 @@ int main(int argc, char* argv[]){
 
     // Initialize the SDL screen
     initSDL();
+    ResetMachine();
+    if(statsEnabled == true){
+        OpenStats();
+    }
 
     // Load and execute the program
     LoadProgram(ROM, arrayLen);
-    ExecuteProgram(arrayLen);
+
+    // Get source lines and labels for traces, profiles, and crashes if the assembler left them
+    LoadDebugInfo();
+    signal(SIGSEGV, CrashHandler);
+    signal(SIGFPE, CrashHandler);
+
+    do{
+        StartCores(arrayLen);
+#ifdef AOT_RUNTIME
+        // Compiled code doesn't stop between instructions, so tracing and profiling always use the interpreter
+        if(tracing == true || profiling == true){
+            ExecuteProgram(arrayLen);
+        }else{
+            ExecuteCompiled(arrayLen);
+        }
+#else
+        ExecuteProgram(arrayLen);
+#endif
+        StopCores();
+        // When watching, keep going with each new version of the program until the user quits
+    }while(watchDescriptor >= 0 && LoadNextVersion(&arrayLen) == true);
 
     closeSDL();
+    CloseStats();
 
     // Print the values of the registers and the program's memory for debug 
     PrintRegisters();
     PrintRAMDebug(arrayLen);
+    int privateBanks, sharedBanks;
+    CountBanks(&privateBanks, &sharedBanks);
+    printf("\nMemory: %d private banks (%d bytes), %d shared with the program image, %llu copied on write\n", privateBanks,
+        privateBanks * BANK_SIZE, sharedBanks, bankCopies);
+    if(profiling == true){
+        PrintProfile();
+    }
 
     free(ROM);                  // After program execution, free the memory taken up by the ROM
     fclose(file);               // Close the file
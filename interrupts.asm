@@ -0,0 +1,27 @@
+; Example program: Sleep until a key is pressed instead of polling the keyboard. Pressing D draws a square at the top left of the screen.
+_start:
+    BSWCHI, 250             ; Go to the I/O bank
+    LDI, A, _KEYHANDLER     ; Get the address of the keyboard handler
+    STORI, A, 224           ; Put it in the keyboard entry of the vector table
+    LDI, A, 0               ; The handler is in bank 0
+    STORI, A, 225
+    LDI, A, 1               ; Unmask the keyboard interrupt (bit 0)
+    STORI, A, 232
+    EI                      ; Turn interrupts on
+
+_sleep:
+    HLT                     ; Sleep until a key is pressed
+    JMPI, _sleep            ; Go back to sleep after the handler returns
+
+_KEYHANDLER:
+    BSWCHI, 250             ; The handler can't know where BI was, so set it
+    LOADI, D, 254           ; Get the key that was pressed
+    CMPI, D, 'd'            ; Was it D?
+    JNEI, _return           ; If not, go back to sleep
+
+    BSWCHI, 251             ; Go to the first VRAM bank
+    LDI, P, 0
+    MOVMI, 255              ; Draw a white square
+
+_return:
+    IRET
@@ -0,0 +1,492 @@
+# The ahead-of-time recompiler for my custom CPU!
+# Takes an assembled program (program.bin by default) and turns it into C code with one label per basic block. The C code includes emulator.c as its
+# runtime, so RAM, VRAM, the keyboard, interrupts, and SDL all work the same way they do in the emulator. The output is compiled with -O2.
+#
+# How it works:
+# - Starting at bank 0 address 0, it follows the code and finds every JMPI/JEI/JNEI target. The bank of the target comes from the SOI in front
+#   of the jump, which is what the assembler puts there for labels.
+# - Every target and every instruction after a branch starts a new block. Blocks jump straight to each other when the target is known.
+# - JMPR/JER/JNER and IRET only know where they go at runtime, so they go through a dispatcher that looks the new PC up in a table. If PC is not
+#   the start of a compiled block, the interpreter runs instructions until it gets back to one.
+# - CALLI targets and the instruction after every call start blocks. Each call remembers the block it returns to, keyed by where its return
+#   address is on the stack, and RET goes straight to that block if the address it pops is the one the call pushed. Otherwise (the program
+#   changed the stack, or the call came from the interpreter) RET goes through the dispatcher like JMPR.
+# - If the program writes to any byte that was compiled, or program.bin is not the program that was compiled, everything falls back to the
+#   interpreter.
+#
+# Usage: python3 recompiler.py [program.bin]
+# Output: program_aot.c and the program_aot executable. program_aot still needs program.bin in the same directory, just like the emulator.
+
+import subprocess
+import sys
+
+# Opcodes. These have to match emulator.c and the instructions dictionary in assembler.py.
+NOP = 0b00000000; SOI = 0b10000000; SOR = 0b10000001; BSWCHI = 0b00100110; BSWCHR = 0b00100111; ADDI = 0b00000010; ADDR = 0b00000011
+SUBI = 0b00000100; SUBR = 0b00000101; LDI = 0b00000110; CPY = 0b00000111; MOVMI = 0b00001000; MOVMR = 0b00001001; GETP = 0b00101001
+SHL = 0b10001011; SHR = 0b10001101; JMPI = 0b00001010; JMPR = 0b00001011; JEI = 0b00001100; JER = 0b00001101; JNEI = 0b00001110
+JNER = 0b00001111; CMPI = 0b00010000; CMPR = 0b00010001; LOADI = 0b00010010; LOADR = 0b00010011; STORI = 0b00010100; STORR = 0b00010101
+PUSHI = 0b00010110; PUSHR = 0b00010111; POP = 0b00011001; INCB = 0b00011000; DECB = 0b00011010; INCR = 0b00011011; DECR = 0b00011101
+ANDI = 0b00011110; ANDR = 0b00011111; ORI = 0b00100000; ORR = 0b00100001; XORI = 0b00100010; XORR = 0b00100011; NOT = 0b00100101
+HLT = 0b00101010; EI = 0b00101011; DI = 0b00101100; IRET = 0b00101101; TAS = 0b00110001; CAS = 0b00110010; CALLI = 0b00101110
+CALLR = 0b00101111; RET = 0b00110000
+
+# Register IDs to the names of the register variables in emulator.c
+registerNames = {0x01: "A", 0x02: "B", 0x03: "C", 0x04: "D", 0x05: "BI", 0x06: "P", 0x07: "S"}
+
+# Instructions that end a block. Everything that can change PC to something other than the next instruction is in here.
+blockEnders = [JMPI, JMPR, JEI, JER, JNEI, JNER, HLT, IRET, CALLI, CALLR, RET]
+
+image = b""
+
+# Get the byte at a 16-bit address (bank << 8 | address). Anything outside of the image is None.
+def ReadByte(location):
+    if location < len(image):
+        return image[location]
+    return None
+
+# Get the location of the instruction after the one at the given location. Running off the end of a bank goes to the next bank.
+def NextLocation(location):
+    bank = location >> 8
+    address = ((location & 0xFF) + 2) & 0xFF
+    if address < 2:
+        bank = (bank + 1) & 0xFF
+    return (bank << 8) | address
+
+# This function finds the start of every basic block by following the code from the entry point and every jump target it can find.
+def FindLeaders():
+    leaders = set([0])
+    worklist = [0]
+    visited = set()
+    while worklist:
+        location = worklist.pop()
+        secondOperand = None
+        while location not in visited:
+            visited.add(location)
+            opcode = ReadByte(location)
+            operand = ReadByte(location + 1)
+            if opcode is None or operand is None:
+                # Off the end of the program. The runtime stops the program or runs the interpreter from here.
+                break
+            following = NextLocation(location)
+
+            if opcode == SOI or opcode == SOR:
+                secondOperand = operand
+            elif opcode in [JMPI, JEI, JNEI, CALLI] and secondOperand is not None:
+                # The SOI in front of the jump has the bank of the target
+                target = (secondOperand << 8) | operand
+                if target not in leaders:
+                    leaders.add(target)
+                    worklist.append(target)
+            elif opcode == NOP:
+                secondOperand = 0
+
+            if opcode in blockEnders:
+                if opcode != JMPI and opcode != IRET and opcode != RET:
+                    # Conditional branches, calls, and HLT can continue with the next instruction, so that starts a block too
+                    if following not in leaders:
+                        leaders.add(following)
+                        worklist.append(following)
+                break
+            location = following
+    return leaders
+
+# This class turns the instructions in one block into C statements. It keeps track of what is in DR2 while it can, so that most instructions
+# end up as a single C statement with the register names and values filled in.
+class BlockCompiler:
+    def __init__(self, blockIDs):
+        self.blockIDs = blockIDs
+        self.lines = []
+        self.secondOperand = None       # What is in DR2 if it is known at compile time. None means the DR2 variable has to be used.
+        self.lastOpcode = None          # What the interpreter would have in ROP
+        self.lastOperand = None         # What the interpreter would have in DR1. SOI/SOR don't change it.
+        self.count = 0                  # Instructions in the block so far. Used for the device slice and the instruction counter.
+        self.bankSwitches = 0           # Bank switches in the block so far, for the bank switch counter
+        self.indent = 1
+
+    def Emit(self, line):
+        if line == "}":
+            self.indent -= 1
+        self.lines.append("    " * self.indent + line)
+        if line.endswith("{"):
+            self.indent += 1
+
+    def DR2(self):
+        if self.secondOperand is None:
+            return "DR2"
+        return str(self.secondOperand)
+
+    # Put the instruction registers back the way the interpreter would have left them. Needed before leaving the block and before calling into
+    # the interpreter.
+    def Flush(self):
+        registers = []
+        if self.lastOpcode is not None:
+            registers.append("ROP = %d;" % self.lastOpcode)
+        if self.lastOperand is not None:
+            registers.append("DR1 = %d;" % self.lastOperand)
+        if self.secondOperand is not None:
+            registers.append("DR2 = %d;" % self.secondOperand)
+        if registers:
+            self.Emit(" ".join(registers))
+
+    # Update the counters when leaving the block. They are only updated once per block instead of after every instruction.
+    def Account(self):
+        if self.bankSwitches > 0:
+            return "sliceRemaining -= %d; bankSwitches += %d;" % (self.count, self.bankSwitches)
+        return "sliceRemaining -= %d;" % self.count
+
+    # Leave the block with PC at the given location
+    def Exit(self, location):
+        self.Flush()
+        self.Emit("PC[0] = %d; PC[1] = %d;" % (location >> 8, location & 0xFF))
+        self.Emit(self.Account())
+        if location in self.blockIDs:
+            self.Emit("CHAIN(block_%d);" % self.blockIDs[location])
+        else:
+            self.Emit("goto dispatch;")
+
+    # Remember which block a call returns to. The stack pointer is just past the return address the call pushed.
+    def PredictReturn(self, following):
+        if following in self.blockIDs:
+            self.Emit("returnLocation[S] = %d; returnBlock[S] = &&block_%d;" % (following, self.blockIDs[following]))
+        else:
+            self.Emit("returnBlock[S] = NULL;")
+
+    # Run one instruction in the interpreter. Used for anything that can't be compiled, like a bad register ID.
+    def Interpret(self, opcode, operand):
+        if self.secondOperand is not None:
+            self.Emit("DR2 = %d;" % self.secondOperand)
+        self.Emit("ExecuteInstruction(%d, %d);" % (opcode, operand))
+        self.secondOperand = None
+
+    # Write to RAM. If it hits compiled code, leave the block so the interpreter takes over from the next instruction.
+    def Write(self, bank, address, value, following):
+        self.Emit("if(CompiledWrite(%s, %s, %s)){" % (bank, address, value))
+        self.Flush()
+        self.Emit("PC[0] = %d; PC[1] = %d; %s goto dispatch;" % (following >> 8, following & 0xFF, self.Account()))
+        self.Emit("}")
+
+    def Compile(self, location, opcode, operand, following):
+        self.count += 1
+        self.lastOpcode = opcode
+        if opcode != SOI and opcode != SOR:
+            self.lastOperand = operand
+        R = registerNames.get(operand)
+        R2 = registerNames.get(self.secondOperand) if self.secondOperand is not None else None
+        # For instructions that use DR2 as a register, it has to be known at compile time
+        needsR = [BSWCHR, ADDR, SUBR, LDI, MOVMR, GETP, SHL, SHR, CMPI, LOADI, LOADR, STORI, STORR, PUSHR, INCR, DECR, ANDR, ORR, XORR, NOT]
+        needsR2 = [CPY, CMPR, LOADR, STORR, ANDI, ANDR, ORI, ORR, XORI, XORR]
+
+        if (opcode in needsR and R is None) or (opcode in needsR2 and R2 is None):
+            self.Interpret(opcode, operand)
+        elif opcode == SOI or opcode == SOR:
+            self.secondOperand = operand
+        elif opcode == NOP:
+            self.secondOperand = 0
+            self.lastOperand = 0
+        elif opcode == BSWCHI:
+            self.Emit("BI = %d;" % operand)
+            self.bankSwitches += 1
+        elif opcode == BSWCHR:
+            self.Emit("BI = %s;" % R)
+            self.bankSwitches += 1
+        elif opcode == ADDI:
+            self.Emit("A = A + %d;" % operand)
+        elif opcode == ADDR:
+            self.Emit("A = A + %s;" % R)
+        elif opcode == SUBI:
+            self.Emit("A = A - %d;" % operand)
+        elif opcode == SUBR:
+            self.Emit("A = A - %s;" % R)
+        elif opcode == LDI:
+            self.Emit("%s = %s;" % (R, self.DR2()))
+        elif opcode == CPY:
+            self.Emit("%s = %s;" % (R, R2))
+        elif opcode == MOVMI:
+            self.Write("BI", "P", str(operand), following)
+        elif opcode == MOVMR:
+            self.Write("BI", "P", R, following)
+        elif opcode == GETP:
+            self.Emit("%s = ReadMemory(BI, P);" % R)
+        elif opcode == SHL:
+            self.Emit("%s = %s << 1;" % (R, R))
+        elif opcode == SHR:
+            self.Emit("%s = %s >> 1;" % (R, R))
+        elif opcode == CMPI:
+            self.Emit("F[EQUAL] = (%s == %s);" % (R, self.DR2()))
+        elif opcode == CMPR:
+            self.Emit("F[EQUAL] = (%s == %s);" % (R, R2))
+        elif opcode == LOADI:
+            self.Emit("%s = ReadMemory(BI, %s);" % (R, self.DR2()))
+        elif opcode == LOADR:
+            self.Emit("%s = ReadMemory(BI, %s);" % (R, R2))
+        elif opcode == STORI:
+            self.Write("BI", self.DR2(), R, following)
+        elif opcode == STORR:
+            self.Write("BI", R2, R, following)
+        elif opcode == PUSHI:
+            self.Emit("stack[S] = %d; S++;" % operand)
+        elif opcode == PUSHR:
+            self.Emit("stack[S] = %s; %s = 0; S++;" % (R, R))
+        elif opcode == POP:
+            self.Emit("S--; B = stack[S]; stack[S] = 0;")
+        elif opcode == INCB:
+            self.Write("BI", "P", "ReadMemory(BI, P) + 1", following)
+        elif opcode == DECB:
+            self.Write("BI", "P", "ReadMemory(BI, P) - 1", following)
+        elif opcode == INCR:
+            self.Emit("%s = %s + 1;" % (R, R))
+        elif opcode == DECR:
+            self.Emit("%s = %s - 1;" % (R, R))
+        elif opcode == ANDI:
+            self.Emit("%s = %d & %s;" % (R2, operand, R2))
+        elif opcode == ANDR:
+            self.Emit("%s = %s & %s;" % (R, R, R2))
+        elif opcode == ORI:
+            self.Emit("%s = %s | %d;" % (R2, R2, operand))
+        elif opcode == ORR:
+            self.Emit("%s = %s | %s;" % (R, R, R2))
+        elif opcode == XORI:
+            self.Emit("%s = %s ^ %d;" % (R2, R2, operand))
+        elif opcode == XORR:
+            self.Emit("%s = %s ^ %s;" % (R, R, R2))
+        elif opcode == NOT:
+            self.Emit("%s = ~%s;" % (R, R))
+        elif opcode == EI:
+            self.Emit("IME = true;")
+        elif opcode == DI:
+            self.Emit("IME = false;")
+        elif opcode in [JMPI, JEI, JNEI]:
+            if self.secondOperand is None:
+                # The bank isn't known, so the interpreter does the jump
+                self.Interpret(opcode, operand)
+                self.Emit("if(JMPFunction == true){ JMPFunction = false; %s goto dispatch; }" % self.Account())
+                self.Exit(following)
+                return
+            target = (self.secondOperand << 8) | operand
+            if opcode == JEI:
+                self.Emit("if(F[EQUAL] == true){")
+            elif opcode == JNEI:
+                self.Emit("if(F[EQUAL] == false){")
+            self.Exit(target)
+            if opcode != JMPI:
+                self.Emit("}")
+                self.Exit(following)
+            return
+        elif opcode == CALLI or (opcode == CALLR and R is not None and R2 is not None):
+            self.Emit("stack[S] = %d; S++; stack[S] = %d; S++;" % (following >> 8, following & 0xFF))
+            self.PredictReturn(following)
+            if opcode == CALLR:
+                self.Flush()
+                self.Emit("PC[0] = %s; PC[1] = %s; %s goto dispatch;" % (R2, R, self.Account()))
+            elif self.secondOperand is None:
+                # The bank isn't known, so only the interpreter knows where this goes
+                self.Flush()
+                self.Emit("PC[0] = DR2; PC[1] = %d; %s goto dispatch;" % (operand, self.Account()))
+            else:
+                self.Exit((self.secondOperand << 8) | operand)
+            return
+        elif opcode == RET:
+            # Pop the return address. If it's the one the call pushed, go straight to the block after the call.
+            self.Flush()
+            self.Emit("S--; S--; PC[1] = stack[(byte)(S + 1)]; PC[0] = stack[S]; %s" % self.Account())
+            self.Emit("if(returnBlock[(byte)(S + 2)] != NULL && returnLocation[(byte)(S + 2)] == ((PC[0] << 8) | PC[1])){")
+            self.Emit("CHAIN(*returnBlock[(byte)(S + 2)]);")
+            self.Emit("}")
+            self.Emit("goto dispatch;")
+            return
+        elif opcode in [JMPR, JER, JNER, IRET, CALLR]:
+            # Where these go is only known at runtime, so let the interpreter work it out and then look up the new PC
+            self.Interpret(opcode, operand)
+            self.Emit("if(JMPFunction == true){ JMPFunction = false; %s goto dispatch; }" % self.Account())
+            self.Exit(following)
+            return
+        elif opcode in [TAS, CAS]:
+            # The atomic instructions run in the interpreter. They write to RAM, so leave the block if they wrote to compiled code.
+            self.Interpret(opcode, operand)
+            self.Emit("CheckInterpretedWrite();")
+            self.Emit("if(CODE_MODIFIED() == true){")
+            self.Emit("PC[0] = %d; PC[1] = %d; %s goto dispatch;" % (following >> 8, following & 0xFF, self.Account()))
+            self.Emit("}")
+        elif opcode == HLT:
+            # Always go back to the dispatcher so it sleeps until an interrupt instead of running the next block
+            self.Emit("halted = true;")
+            self.Flush()
+            self.Emit("PC[0] = %d; PC[1] = %d; %s goto dispatch;" % (following >> 8, following & 0xFF, self.Account()))
+            return
+        else:
+            # Unknown opcodes do nothing in the interpreter, but they still change ROP and DR1
+            self.Interpret(opcode, operand)
+
+# This function writes the C code for every block
+def CompileProgram(leaders):
+    blockIDs = {}
+    for location in sorted(leaders):
+        if ReadByte(location) is not None and ReadByte(location + 1) is not None:
+            blockIDs[location] = len(blockIDs) + 1
+
+    blocks = []
+    compiledBytes = set()
+    for location, blockID in sorted(blockIDs.items(), key=lambda item: item[1]):
+        compiler = BlockCompiler(blockIDs)
+        compiler.lines.append("block_%d:    // Bank %d address %d" % (blockID, location >> 8, location & 0xFF))
+        while True:
+            opcode = ReadByte(location)
+            operand = ReadByte(location + 1)
+            if opcode is None or operand is None:
+                compiler.Exit(location)
+                break
+            compiledBytes.add(location)
+            compiledBytes.add(location + 1)
+            following = NextLocation(location)
+            compiler.Compile(location, opcode, operand, following)
+            if opcode in blockEnders:
+                break
+            if following in blockIDs:
+                compiler.Exit(following)
+                break
+            location = following
+        blocks.append("\n".join(compiler.lines))
+    return blockIDs, compiledBytes, blocks
+
+# This function puts the whole C file together
+def WriteProgram(outputName, blockIDs, compiledBytes, blocks):
+    digest = 2166136261
+    for value in image:
+        digest = ((digest ^ value) * 16777619) & 0xFFFFFFFF
+
+    output = []
+    output.append("/* Generated by recompiler.py. Do not edit, change the assembly and run the recompiler again instead. */")
+    output.append("#define AOT_RUNTIME")
+    output.append('#include "emulator.c"')
+    output.append("")
+    output.append("#define IMAGE_LENGTH %d" % len(image))
+    output.append("#define IMAGE_DIGEST %du" % digest)
+    output.append("")
+    output.append("// Start of every block, in block ID order")
+    output.append("static const word blockLocations[] = { 0, %s };" % ", ".join(str(location) for location in sorted(blockIDs, key=blockIDs.get)))
+    output.append("// Every byte that was compiled, as bank << 8 | address")
+    output.append("static const word compiledLocations[] = { %s };" % ", ".join(str(location) for location in sorted(compiledBytes)))
+    output.append("")
+    output.append("static word blockAt[0x10000];             // Block ID of every location that starts a block, 0 if none")
+    output.append("static bool compiledByte[0x10000];        // True for every byte that was compiled")
+    output.append("static bool codeModified = false;         // Set once the compiled code can't be trusted anymore")
+    output.append("#define CODE_MODIFIED() __atomic_load_n(&codeModified, __ATOMIC_RELAXED)    // The other cores can set it at any time")
+    output.append("static word returnLocation[256];          // Where the call whose return address ends at this stack position returns to")
+    output.append("static void* returnBlock[256];            // The block at that location, or NULL if there isn't one")
+    output.append("")
+    output.append("// Write to RAM. Returns true if the write hit compiled code, which means the interpreter has to take over.")
+    output.append("static inline bool CompiledWrite(byte bank, byte address, byte value){")
+    output.append("    WriteMemory(bank, address, value);")
+    output.append("    if(compiledByte[(bank << 8) | address] == true){")
+    output.append("        __atomic_store_n(&codeModified, true, __ATOMIC_RELAXED);")
+    output.append("    }")
+    output.append("    return CODE_MODIFIED();")
+    output.append("}")
+    output.append("")
+    output.append("// The interpreter writes to RAM directly, so check whether the instruction it just ran wrote to compiled code. The other cores only run")
+    output.append("// in the interpreter, and they call this after every instruction through interpretedWriteHook.")
+    output.append("static void CheckInterpretedWrite(){")
+    output.append("    int location = -1;")
+    output.append("    if(ROP == MOVMI || ROP == MOVMR || ROP == INCB || ROP == DECB || ROP == CAS){")
+    output.append("        location = (BI << 8) | P;")
+    output.append("    }else if(ROP == STORI || ROP == TAS){")
+    output.append("        location = (BI << 8) | DR2;")
+    output.append("    }else if(ROP == STORR && GetRegister(DR2) != NULL){")
+    output.append("        location = (BI << 8) | *GetRegister(DR2);")
+    output.append("    }")
+    output.append("    if(location >= 0 && compiledByte[location] == true){")
+    output.append("        __atomic_store_n(&codeModified, true, __ATOMIC_RELAXED);")
+    output.append("    }")
+    output.append("}")
+    output.append("")
+    output.append("// Go straight to the next block unless the devices need attention, an interrupt has to be taken, or another core wrote to compiled code")
+    output.append("#define CHAIN(block) if(sliceRemaining > 0 && (IME == false || InterruptWaiting() == false) && CODE_MODIFIED() == false){ goto block; } \\")
+    output.append("    goto dispatch;")
+    output.append("")
+    output.append("void ExecuteCompiled(int programLength){")
+    output.append("    for(int i = 1; i < (int)(sizeof(blockLocations) / sizeof(blockLocations[0])); i++){")
+    output.append("        blockAt[blockLocations[i]] = i;")
+    output.append("    }")
+    output.append("    for(int i = 0; i < (int)(sizeof(compiledLocations) / sizeof(compiledLocations[0])); i++){")
+    output.append("        compiledByte[compiledLocations[i]] = true;")
+    output.append("    }")
+    output.append("")
+    output.append("    // If program.bin is not the program that was compiled, only the interpreter can run it. This is checked on every call since the")
+    output.append("    // emulator can load a new version of the program without restarting (--watch), which throws out anything known about the old one.")
+    output.append("    codeModified = false;")
+    output.append("    interpretedWriteHook = CheckInterpretedWrite;")
+    output.append("    unsigned int digest = 2166136261u;")
+    output.append("    for(int i = 0; i < IMAGE_LENGTH; i++){")
+    output.append("        digest = (digest ^ RAM[i / BANK_SIZE]->address[i % BANK_SIZE]) * 16777619u;")
+    output.append("    }")
+    output.append("    if(programLength != IMAGE_LENGTH || digest != IMAGE_DIGEST){")
+    output.append('        fprintf(stderr, "program.bin does not match the compiled program. Using the interpreter.\\n");')
+    output.append("        codeModified = true;")
+    output.append("    }")
+    output.append("")
+    output.append("    PC[0] = 0;")
+    output.append("    PC[1] = 0;")
+    output.append("    ServiceDevices();")
+    output.append("    sliceLength = NextSlice();")
+    output.append("    sliceRemaining = sliceLength;")
+    output.append("")
+    output.append("dispatch:")
+    output.append("    if(sliceRemaining <= 0){")
+    output.append("        // Blocks can go a little past the end of the slice, so count what was really executed")
+    output.append("        instructionsExecuted += sliceLength - sliceRemaining;")
+    output.append("        ServiceDevices();")
+    output.append("        sliceLength = NextSlice();")
+    output.append("        sliceRemaining = sliceLength;")
+    output.append("    }")
+    output.append("    if(sliceRemaining == 0 || ProgramRunning(programLength) == false){")
+    output.append("        instructionsExecuted += sliceLength - sliceRemaining;")
+    output.append("        sliceLength = 0;")
+    output.append("        sliceRemaining = 0;")
+    output.append("        return;")
+    output.append("    }")
+    output.append("    if(halted == true){")
+    output.append("        WaitForInterrupt();")
+    output.append("        goto dispatch;")
+    output.append("    }")
+    output.append("    if(IME == true && ROP != SOI && ROP != SOR && InterruptWaiting() == true){")
+    output.append("        DispatchInterrupt();")
+    output.append("    }")
+    output.append("    if(CODE_MODIFIED() == false){")
+    output.append("        switch(blockAt[(PC[0] << 8) | PC[1]]){")
+    for location, blockID in sorted(blockIDs.items(), key=lambda item: item[1]):
+        output.append("            case %d: goto block_%d;" % (blockID, blockID))
+    output.append("        }")
+    output.append("    }")
+    output.append("    // PC is not at a compiled block, so run one instruction in the interpreter and try again")
+    output.append("    StepInstruction();")
+    output.append("    CheckInterpretedWrite();")
+    output.append("    sliceRemaining--;")
+    output.append("    goto dispatch;")
+    output.append("")
+    for block in blocks:
+        output.append(block)
+        output.append("")
+    output.append("}")
+
+    with open(outputName, "w") as outputFile:
+        outputFile.write("\n".join(output) + "\n")
+
+# Get the name of the program to compile
+fileName = "program.bin"
+if len(sys.argv) > 1:
+    fileName = sys.argv[1]
+
+with open(fileName, "rb") as binaryFile:
+    image = binaryFile.read()
+
+leaders = FindLeaders()
+blockIDs, compiledBytes, blocks = CompileProgram(leaders)
+WriteProgram("program_aot.c", blockIDs, compiledBytes, blocks)
+print(str(len(blockIDs)) + " blocks compiled to program_aot.c.")
+
+# Compile it the same way as the emulator, but with optimizations on
+result = subprocess.run(["gcc", "-O2", "program_aot.c", "-o", "program_aot", "-lSDL2", "-lpthread", "-lrt"])
+if result.returncode != 0:
+    print("Error: gcc could not compile program_aot.c.")
+    exit(1)
+print("Compiled to program_aot.")
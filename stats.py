@@ -0,0 +1,125 @@
+# Shows the live stats of a running emulator. The emulator keeps them in shared memory (/dev/shm/emulator-stats-<pid>) and updates them 10 times a
+# second, so this never slows it down.
+#
+# Usage:
+# python3 stats.py [pid]
+#     Without a pid, it shows the emulator that is running, or lists them if there is more than one. Press Ctrl+C to stop.
+
+import glob
+import os
+import struct
+import sys
+import time
+
+# This has to match EmulatorStats in the live stats region of emulator.c
+STATS_MAGIC = 0x53554d45
+STATS_VERSION = 1
+FRAME_BUCKETS = 16
+statsFormat = "=II" + "Q" * (16 + FRAME_BUCKETS)
+fields = ["magic", "version", "sequence", "pid", "uptime", "instructions", "cycles", "mipsNow", "mipsAverage", "idleNow", "idleAverage", "vblanks",
+          "framesDrawn", "frameTime", "polls", "pollTime", "pollMax", "pc", "cores"]
+
+def Running(pid):
+    try:
+        os.kill(pid, 0)
+    except ProcessLookupError:
+        return False
+    except PermissionError:
+        pass
+    return True
+
+# Find the stats of every emulator that is running. Stats left behind by an emulator that crashed are deleted.
+def FindEmulators():
+    pids = []
+    for path in glob.glob("/dev/shm/emulator-stats-*"):
+        pid = int(path.rsplit("-", 1)[1])
+        if Running(pid):
+            pids.append(pid)
+        else:
+            try:
+                os.remove(path)
+            except OSError:
+                pass
+    return sorted(pids)
+
+# Read a consistent copy of the stats. The sequence number is odd while the emulator is writing them, so keep trying until a copy was read
+# with the same even number before and after.
+def ReadStats(statsFile):
+    size = struct.calcsize(statsFormat)
+    for attempt in range(1000):
+        statsFile.seek(0)
+        data = statsFile.read(size)
+        if len(data) < size:
+            return None
+        values = struct.unpack(statsFormat, data)
+        statsFile.seek(8)
+        sequenceAfter = struct.unpack("=Q", statsFile.read(8))[0]
+        if values[2] % 2 == 0 and values[2] == sequenceAfter:
+            stats = dict(zip(fields[:13], values[:13]))
+            stats["frameTime"] = list(values[13:13 + FRAME_BUCKETS])
+            stats.update(zip(fields[14:], values[13 + FRAME_BUCKETS:]))
+            return stats
+        time.sleep(0.001)
+    return None
+
+# The bucket that the given fraction of the redraws fall under
+def Percentile(buckets, fraction):
+    total = sum(buckets)
+    if total == 0:
+        return 0
+    count = 0
+    for bucket, frames in enumerate(buckets):
+        count += frames
+        if count >= total * fraction:
+            return 2 << bucket
+    return 2 << (len(buckets) - 1)
+
+def Show(pid):
+    try:
+        statsFile = open("/dev/shm/emulator-stats-%i" % pid, "rb", buffering=0)
+    except OSError:
+        print("Error: there is no emulator with pid %i." % pid)
+        exit(1)
+
+    last = None
+    while Running(pid):
+        stats = ReadStats(statsFile)
+        if stats is None or stats["magic"] != STATS_MAGIC or stats["version"] != STATS_VERSION:
+            print("Error: the stats of emulator %i don't match this version of stats.py." % pid)
+            exit(1)
+        if last is not None and stats["sequence"] != last["sequence"]:
+            # Everything that isn't a rate is shown for the time since the last update
+            seconds = max((stats["uptime"] - last["uptime"]) / 1e9, 1e-9)
+            vblanks = stats["vblanks"] - last["vblanks"]
+            frames = stats["framesDrawn"] - last["framesDrawn"]
+            buckets = [now - before for now, before in zip(stats["frameTime"], last["frameTime"])]
+            polls = stats["polls"] - last["polls"]
+            pollTime = stats["pollTime"] - last["pollTime"]
+            print("\033[2J\033[H", end="")
+            print("Emulator %i, %i cores, up %.1f seconds" % (pid, stats["cores"], stats["uptime"] / 1e9))
+            print("PC: bank %i, address %i" % (stats["pc"] >> 8, stats["pc"] & 0xff))
+            print("Speed: %.2f MIPS now, %.2f average" % (stats["mipsNow"] / 1000, stats["mipsAverage"] / 1000))
+            print("Instructions: %i, cycles: %i" % (stats["instructions"], stats["cycles"]))
+            print("Idle: %.1f%% now, %.1f%% average" % (stats["idleNow"] / 100, stats["idleAverage"] / 100))
+            print("Frames: %.1f per second, %.1f%% of them redrawn because VRAM changed" % (vblanks / seconds, 100 * frames / max(vblanks, 1)))
+            print("Redraw time: p50 under %i microseconds, p99 under %i microseconds" % (Percentile(buckets, 0.5), Percentile(buckets, 0.99)))
+            print("Event polls: %.1f per second, %.1f microseconds average, %.1f longest ever" % (polls / seconds, pollTime / max(polls, 1) / 1000,
+                stats["pollMax"] / 1000))
+            sys.stdout.flush()
+        if last is None or stats["sequence"] != last["sequence"]:
+            last = stats
+        time.sleep(1)
+    print("Emulator %i has stopped." % pid)
+
+if len(sys.argv) > 1:
+    Show(int(sys.argv[1]))
+else:
+    pids = FindEmulators()
+    if len(pids) == 0:
+        print("No emulator is running.")
+    elif len(pids) == 1:
+        Show(pids[0])
+    else:
+        print("More than one emulator is running. Pick one with python3 stats.py [pid]:")
+        for pid in pids:
+            print(pid)